@@ -26,6 +26,7 @@
 #include <linux/genetlink.h>
 #include <linux/taskstats.h>
 #include <linux/cgroupstats.h>
+#include <linux/taskstats_ring.h>
 
 /*
  * Generic macros for dealing with netlink sockets. Might be duplicated
@@ -50,6 +51,7 @@ int dbg;
 int print_delays;
 int print_io_accounting;
 int print_task_context_switch_counts;
+int dump_rings;
 __u64 stime, utime;
 
 #define PRINTF(fmt, arg...) {			\
@@ -73,13 +75,14 @@ char cpumask[100+6*MAX_CPUS];
 
 static void usage(void)
 {
-	fprintf(stderr, "getdelays [-dilv] [-w logfile] [-r bufsize] "
+	fprintf(stderr, "getdelays [-dilvR] [-w logfile] [-r bufsize] "
 			"[-m cpumask] [-t tgid] [-p pid]\n");
 	fprintf(stderr, "  -d: print delayacct stats\n");
 	fprintf(stderr, "  -i: print IO accounting (works only with -p)\n");
 	fprintf(stderr, "  -l: listen forever\n");
 	fprintf(stderr, "  -v: debug on\n");
 	fprintf(stderr, "  -C: container path\n");
+	fprintf(stderr, "  -R: drain the scheduling accounting rings\n");
 }
 
 /*
@@ -235,6 +238,103 @@ static void print_cgroupstats(struct cgroupstats *c)
 }
 
 
+static void print_ring(struct taskstats_ring_entry *e, int nr)
+{
+	for (; nr > 0; nr--, e++)
+		printf("%llu.%06llu cpu%u %u/%u %c run %u delay %u io %u "
+		       "csw %u/%u mig %u flt %u/%u\n",
+		       (unsigned long long)e->timestamp / 1000000000,
+		       (unsigned long long)e->timestamp % 1000000000 / 1000,
+		       e->cpu, e->tgid, e->pid,
+		       e->state < 5 ? "RSDIO"[e->state] : '?',
+		       e->run_time, e->run_delay, e->io_delay,
+		       e->nvcsw, e->nivcsw, e->migrations,
+		       e->min_flt, e->maj_flt);
+}
+
+/*
+ * Drain the per-cpu accounting rings with a TASKSTATS_RING_CMD_GET dump,
+ * printing the entries or, with -w, writing them to the log file
+ */
+static int dump_ring(int sd, __u16 id, __u32 mypid, int fd)
+{
+	static char buf[32768];
+	struct {
+		struct nlmsghdr n;
+		struct genlmsghdr g;
+	} req;
+	struct sockaddr_nl nladdr;
+	struct nlmsghdr *n;
+	int rep_len;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	req.n.nlmsg_type = id;
+	req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.n.nlmsg_pid = mypid;
+	req.g.cmd = TASKSTATS_RING_CMD_GET;
+	req.g.version = 0x1;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(sd, &req, req.n.nlmsg_len, 0, (struct sockaddr *) &nladdr,
+		   sizeof(nladdr)) < 0)
+		return -1;
+
+	while (1) {
+		rep_len = recv(sd, buf, sizeof(buf), 0);
+		PRINTF("received %d bytes\n", rep_len);
+		if (rep_len < 0)
+			return -1;
+
+		for (n = (struct nlmsghdr *) buf; NLMSG_OK(n, rep_len);
+		     n = NLMSG_NEXT(n, rep_len)) {
+			struct nlattr *na;
+			int len = 0, plen, cpu = -1;
+
+			if (n->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (n->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(n);
+				fprintf(stderr, "fatal reply error,  errno %d\n",
+					err->error);
+				return -1;
+			}
+
+			plen = GENLMSG_PAYLOAD(n);
+			na = (struct nlattr *) GENLMSG_DATA(n);
+			while (len < plen) {
+				switch (na->nla_type) {
+				case TASKSTATS_RING_TYPE_CPU:
+					cpu = *(__u32 *) NLA_DATA(na);
+					break;
+				case TASKSTATS_RING_TYPE_LOST:
+					printf("cpu%d: %llu entries lost\n", cpu,
+					       *(unsigned long long *) NLA_DATA(na));
+					break;
+				case TASKSTATS_RING_TYPE_ENTRIES:
+					if (fd) {
+						if (write(fd, NLA_DATA(na),
+							  NLA_PAYLOAD(na->nla_len)) < 0)
+							err(1, "write error\n");
+						break;
+					}
+					print_ring(NLA_DATA(na),
+						   NLA_PAYLOAD(na->nla_len) /
+						   sizeof(struct taskstats_ring_entry));
+					break;
+				default:
+					fprintf(stderr, "Unknown nla_type %d\n",
+						na->nla_type);
+					break;
+				}
+				len += NLA_ALIGN(na->nla_len);
+				na = (struct nlattr *) (GENLMSG_DATA(n) + len);
+			}
+		}
+	}
+}
+
 static void print_ioacct(struct taskstats *t)
 {
 	printf("%s: read=%llu, write=%llu, cancelled_write=%llu\n",
@@ -270,7 +370,7 @@ int main(int argc, char *argv[])
 	struct msgtemplate msg;
 
 	while (1) {
-		c = getopt(argc, argv, "qdiw:r:m:t:p:vlC:");
+		c = getopt(argc, argv, "qdiw:r:m:t:p:vlC:R");
 		if (c < 0)
 			break;
 
@@ -327,6 +427,9 @@ int main(int argc, char *argv[])
 			printf("listen forever\n");
 			loop = 1;
 			break;
+		case 'R':
+			dump_rings = 1;
+			break;
 		default:
 			usage();
 			exit(-1);
@@ -365,6 +468,14 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (dump_rings) {
+		rc = dump_ring(nl_sd, id, mypid, fd);
+		PRINTF("Dumped rings, retval %d\n", rc);
+		if (rc < 0)
+			fprintf(stderr, "error dumping rings\n");
+		goto done;
+	}
+
 	if (tid && containerset) {
 		fprintf(stderr, "Select either -t or -C, not both\n");
 		goto err;
@@ -0,0 +1,148 @@
+/*
+ * Anonymous memory pressure benchmark for swap-out and swap-in.
+ *
+ * Maps an anonymous area larger than the memory left to the program and
+ * writes one word per page of it in a number of passes, so that every
+ * pass has to swap out the pages written by the previous one and swap
+ * them back in.  The throughput of each pass and the pswpin / pswpout
+ * deltas from /proc/vmstat are reported.
+ *
+ * Usage: swap-pressure <megabytes> [passes] [threads]
+ *
+ * Run it in a memory cgroup or with mem= to keep the size reasonable,
+ * and compare the MB/s of kernels built with different swap settings.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+struct vmstat {
+	unsigned long pswpin;
+	unsigned long pswpout;
+};
+
+struct worker {
+	pthread_t thread;
+	char *start;
+	size_t len;
+	unsigned long pass;
+};
+
+static long page_size;
+
+static void read_vmstat(struct vmstat *vs)
+{
+	char name[64];
+	unsigned long val;
+	FILE *f;
+
+	memset(vs, 0, sizeof(*vs));
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %lu", name, &val) == 2) {
+		if (!strcmp(name, "pswpin"))
+			vs->pswpin = val;
+		else if (!strcmp(name, "pswpout"))
+			vs->pswpout = val;
+	}
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *touch(void *arg)
+{
+	struct worker *w = arg;
+	size_t off;
+
+	for (off = 0; off < w->len; off += page_size) {
+		unsigned long *p = (unsigned long *)(w->start + off);
+
+		/* check the previous pass came back from swap intact */
+		if (w->pass && *p != w->pass - 1 + off) {
+			fprintf(stderr, "corruption at %p\n", p);
+			exit(1);
+		}
+		*p = w->pass + off;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct vmstat before, after;
+	struct worker *workers;
+	unsigned long pass, passes = 4;
+	int i, threads = 1;
+	size_t len, chunk;
+	double t;
+	char *area;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <megabytes> [passes] [threads]\n",
+			argv[0]);
+		return 1;
+	}
+	len = strtoul(argv[1], NULL, 0) << 20;
+	if (argc > 2)
+		passes = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		threads = atoi(argv[3]);
+	if (!len || threads < 1) {
+		fprintf(stderr, "invalid size or thread count\n");
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	workers = calloc(threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+	chunk = (len / threads) & ~(page_size - 1);
+	for (i = 0; i < threads; i++) {
+		workers[i].start = area + i * chunk;
+		workers[i].len = i == threads - 1 ? len - i * chunk : chunk;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		read_vmstat(&before);
+		t = now();
+		for (i = 0; i < threads; i++) {
+			workers[i].pass = pass;
+			pthread_create(&workers[i].thread, NULL, touch,
+				       &workers[i]);
+		}
+		for (i = 0; i < threads; i++)
+			pthread_join(workers[i].thread, NULL);
+		t = now() - t;
+		read_vmstat(&after);
+
+		printf("pass %lu: %.1f MB/s, pswpin %lu, pswpout %lu\n",
+		       pass, (len >> 20) / t,
+		       after.pswpin - before.pswpin,
+		       after.pswpout - before.pswpout);
+	}
+
+	munmap(area, len);
+	free(workers);
+	return 0;
+}
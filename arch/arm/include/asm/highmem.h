@@ -39,6 +39,11 @@ extern void *kmap_atomic(struct page *page, enum km_type type);
 extern void kunmap_atomic(void *kvaddr, enum km_type type);
 extern void *kmap_atomic_pfn(unsigned long pfn, enum km_type type);
 extern struct page *kmap_atomic_to_page(const void *ptr);
+
+#define ARCH_HAS_KMAP_ATOMIC_PAGES
+extern void kmap_atomic_pages(struct page **pages, void **addrs, int nr,
+			      enum km_type type);
+extern void kunmap_atomic_pages(void **addrs, int nr, enum km_type type);
 #endif
 
 #endif
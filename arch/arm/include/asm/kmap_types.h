@@ -1,6 +1,9 @@
 #ifndef __ARM_KMAP_TYPES_H
 #define __ARM_KMAP_TYPES_H
 
+/* consecutive slots for kmap_atomic_pages() batches */
+#define KM_PAGES_NR	8
+
 /*
  * This is the "bare minimum".  AIO seems to require this.
  */
@@ -20,6 +23,8 @@ enum km_type {
 	KM_SOFTIRQ1,
 	KM_L1_CACHE,
 	KM_L2_CACHE,
+	KM_PAGES,
+	KM_PAGES_LAST = KM_PAGES + KM_PAGES_NR - 1,
 	KM_TYPE_NR
 };
 
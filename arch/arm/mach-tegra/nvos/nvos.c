@@ -51,6 +51,10 @@
 #include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/pagemap.h>
 #include <linux/dma-mapping.h>
 #include <asm/atomic.h>
@@ -529,27 +533,161 @@ NvError NvOsGetConfigString(const char *name, char *value, NvU32 size)
     return NvError_NotImplemented;
 }
 
+/*
+ * NvOsAlloc is tiered by size: blocks that fit one of the dedicated slab
+ * caches come from there, blocks up to NVOS_KMALLOC_MAX from kmalloc and
+ * only larger blocks (or kmalloc failures) from vmalloc.  Every block is
+ * preceded by a header holding its size, the tier it came from and the
+ * call site that allocated it, so that NvOsFree can return it to the
+ * right allocator and NvOsRealloc can grow or shrink it in place while
+ * the new size still fits.
+ */
+typedef struct NvOsAllocHeaderRec
+{
+    NvU32 Size;
+    NvU16 Tier;
+    NvU16 Site;
+} NvOsAllocHeader;
+
+enum
+{
+    NvOsAllocTier_Cache32,
+    NvOsAllocTier_Cache64,
+    NvOsAllocTier_Cache128,
+    NvOsAllocTier_Cache256,
+    NvOsAllocTier_Kmalloc,
+    NvOsAllocTier_Vmalloc,
+    NvOsAllocTier_Num,
+    NvOsAllocTier_Caches = NvOsAllocTier_Kmalloc
+};
+
+/* Above this kmalloc would need a high order allocation */
+#define NVOS_KMALLOC_MAX (4 * PAGE_SIZE)
+
+static const size_t s_AllocCacheSize[NvOsAllocTier_Caches] = {
+    32, 64, 128, 256
+};
+static const char * const s_AllocCacheName[NvOsAllocTier_Caches] = {
+    "nvos-32", "nvos-64", "nvos-128", "nvos-256"
+};
+static struct kmem_cache *s_AllocCache[NvOsAllocTier_Caches];
+
+/*
+ * Per call site counters.  Sites are entered into an open addressed table
+ * on their first allocation and never removed; once the table is full the
+ * remaining sites share the last entry.
+ */
+#define NVOS_ALLOC_SITE_BITS 8
+#define NVOS_ALLOC_SITES (1 << NVOS_ALLOC_SITE_BITS)
+
+typedef struct NvOsAllocSiteRec
+{
+    void *Caller;
+    atomic_t Allocs[NvOsAllocTier_Num];
+    atomic_t Live;
+    atomic_long_t LiveBytes;
+} NvOsAllocSite;
+
+static NvOsAllocSite s_AllocSites[NVOS_ALLOC_SITES + 1];
+
+static NvU16 NvOsAllocSiteIndex(void *Caller)
+{
+    unsigned long i = hash_ptr(Caller, NVOS_ALLOC_SITE_BITS);
+    unsigned long n;
+    void *Old;
+
+    for (n = 0; n < NVOS_ALLOC_SITES; n++)
+    {
+        Old = s_AllocSites[i].Caller;
+        if (Old == Caller)
+            return i;
+        if (!Old)
+        {
+            Old = cmpxchg(&s_AllocSites[i].Caller, NULL, Caller);
+            if (!Old || Old == Caller)
+                return i;
+        }
+        i = (i + 1) & (NVOS_ALLOC_SITES - 1);
+    }
+    return NVOS_ALLOC_SITES;
+}
+
+static void *NvOsAllocFrom(size_t size, void *Caller)
+{
+    size_t AllocSize = size + sizeof(NvOsAllocHeader);
+    NvOsAllocHeader *hdr = NULL;
+    NvOsAllocSite *Site;
+    NvU16 Tier;
+
+    if (size > (NvU32)~0 - sizeof(NvOsAllocHeader))
+        return NULL;
+
+    for (Tier = 0; Tier < NvOsAllocTier_Caches; Tier++)
+    {
+        if (AllocSize <= s_AllocCacheSize[Tier])
+            break;
+    }
+    if (Tier < NvOsAllocTier_Caches && s_AllocCache[Tier])
+        hdr = kmem_cache_alloc(s_AllocCache[Tier], GFP_KERNEL);
+    else if (AllocSize <= NVOS_KMALLOC_MAX)
+    {
+        gfp_t Flags = GFP_KERNEL | __GFP_NOWARN;
+
+        // Don't let order 1 and 2 requests reclaim and OOM when vmalloc
+        // can do without contiguous pages.
+        if (AllocSize > PAGE_SIZE)
+            Flags |= __GFP_NORETRY;
+        Tier = NvOsAllocTier_Kmalloc;
+        hdr = kmalloc(AllocSize, Flags);
+    }
+    if (!hdr)
+    {
+        Tier = NvOsAllocTier_Vmalloc;
+        hdr = vmalloc(AllocSize);
+        if (!hdr)
+            return NULL;
+    }
+
+    hdr->Size = size;
+    hdr->Tier = Tier;
+    hdr->Site = NvOsAllocSiteIndex(Caller);
+
+    Site = &s_AllocSites[hdr->Site];
+    atomic_inc(&Site->Allocs[Tier]);
+    atomic_inc(&Site->Live);
+    atomic_long_add(size, &Site->LiveBytes);
+    return hdr + 1;
+}
+
+/* Bytes usable by the caller in the block behind hdr */
+static size_t NvOsAllocUsable(NvOsAllocHeader *hdr)
+{
+    switch (hdr->Tier)
+    {
+    case NvOsAllocTier_Vmalloc:
+        return PAGE_ALIGN(hdr->Size + sizeof(*hdr)) - sizeof(*hdr);
+    case NvOsAllocTier_Kmalloc:
+        return ksize(hdr) - sizeof(*hdr);
+    default:
+        return s_AllocCacheSize[hdr->Tier] - sizeof(*hdr);
+    }
+}
+
 void *NvOsAlloc(size_t size)
 {
-    size_t AllocSize = size + sizeof(size_t);
-    size_t* ptr = NULL;
-    ptr = vmalloc(AllocSize);
-    if (!ptr)
-        return ptr;
-    *ptr = size;
-    ptr++;
-    return (ptr);
+    return NvOsAllocFrom(size, __builtin_return_address(0));
 }
 
-void *NvOsRealloc(void *ptr, size_t size)
+static void *NvOsReallocFrom(void *ptr, size_t size, void *Caller)
 {
-    size_t* NewPtr = NULL;
+    NvOsAllocHeader *hdr;
+    void *NewPtr = NULL;
     size_t OldSize = 0;
     size_t SmallerSize = 0;
 
     if( !ptr )
     {
-        return NvOsAlloc(size);
+        return NvOsAllocFrom(size, Caller);
     }
     if (!size)
     {
@@ -558,14 +696,24 @@ void *NvOsRealloc(void *ptr, size_t size)
     }
 
     // Get the size of the memory allocated for ptr.
-    NewPtr = (size_t*)ptr;
-    NewPtr--;
-    OldSize = *NewPtr;
+    hdr = (NvOsAllocHeader *)ptr - 1;
+    OldSize = hdr->Size;
     if (size == OldSize)
         return ptr;
+
+    // Resize in place while the block is large enough and, when
+    // shrinking, not more than twice as large as needed.
+    if (size <= NvOsAllocUsable(hdr) &&
+        (size > OldSize || size * 2 > NvOsAllocUsable(hdr)))
+    {
+        atomic_long_add((long)size - (long)OldSize,
+            &s_AllocSites[hdr->Site].LiveBytes);
+        hdr->Size = size;
+        return ptr;
+    }
     SmallerSize = (OldSize > size) ? size : OldSize;
 
-    NewPtr = NvOsAlloc(size);
+    NewPtr = NvOsAllocFrom(size, Caller);
     if(!NewPtr)
         return NULL;
     NvOsMemcpy(NewPtr, ptr, SmallerSize);
@@ -573,19 +721,100 @@ void *NvOsRealloc(void *ptr, size_t size)
     return NewPtr;
 }
 
+void *NvOsRealloc(void *ptr, size_t size)
+{
+    return NvOsReallocFrom(ptr, size, __builtin_return_address(0));
+}
+
 void NvOsFree(void *ptr)
 {
-    size_t* AllocPtr = NULL;
-    if (ptr)
+    NvOsAllocHeader *hdr;
+    NvOsAllocSite *Site;
+
+    if (!ptr)
+        return;
+
+    hdr = (NvOsAllocHeader *)ptr - 1;
+    Site = &s_AllocSites[hdr->Site];
+    atomic_dec(&Site->Live);
+    atomic_long_sub(hdr->Size, &Site->LiveBytes);
+
+    switch (hdr->Tier)
     {
-        AllocPtr = (size_t*)ptr;
-        AllocPtr--;
+    case NvOsAllocTier_Vmalloc:
+        vfree(hdr);
+        break;
+    case NvOsAllocTier_Kmalloc:
+        kfree(hdr);
+        break;
+    default:
+        kmem_cache_free(s_AllocCache[hdr->Tier], hdr);
+        break;
     }
-    else
-        return;
-    vfree(AllocPtr);
 }
 
+static int __init NvOsAllocInit(void)
+{
+    int i;
+
+    for (i = 0; i < NvOsAllocTier_Caches; i++)
+        s_AllocCache[i] = kmem_cache_create(s_AllocCacheName[i],
+            s_AllocCacheSize[i], 0, SLAB_HWCACHE_ALIGN, NULL);
+    return 0;
+}
+core_initcall(NvOsAllocInit);
+
+#ifdef CONFIG_DEBUG_FS
+static int NvOsAllocShow(struct seq_file *s, void *data)
+{
+    NvOsAllocSite *Site;
+    int i;
+
+    seq_printf(s, "%-48s %8s %8s %8s %8s %8s %8s %8s %10s\n", "site",
+        "32", "64", "128", "256", "kmalloc", "vmalloc", "live", "bytes");
+    for (i = 0; i <= NVOS_ALLOC_SITES; i++)
+    {
+        Site = &s_AllocSites[i];
+        if (i < NVOS_ALLOC_SITES && !Site->Caller)
+            continue;
+        if (i == NVOS_ALLOC_SITES)
+            seq_printf(s, "%-48s", "(other)");
+        else
+            seq_printf(s, "%-48pS", Site->Caller);
+        seq_printf(s, " %8d %8d %8d %8d %8d %8d %8d %10ld\n",
+            atomic_read(&Site->Allocs[NvOsAllocTier_Cache32]),
+            atomic_read(&Site->Allocs[NvOsAllocTier_Cache64]),
+            atomic_read(&Site->Allocs[NvOsAllocTier_Cache128]),
+            atomic_read(&Site->Allocs[NvOsAllocTier_Cache256]),
+            atomic_read(&Site->Allocs[NvOsAllocTier_Kmalloc]),
+            atomic_read(&Site->Allocs[NvOsAllocTier_Vmalloc]),
+            atomic_read(&Site->Live),
+            atomic_long_read(&Site->LiveBytes));
+    }
+    return 0;
+}
+
+static int NvOsAllocOpen(struct inode *inode, struct file *file)
+{
+    return single_open(file, NvOsAllocShow, NULL);
+}
+
+static const struct file_operations s_NvOsAllocFops = {
+    .open = NvOsAllocOpen,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static int __init NvOsAllocDebugInit(void)
+{
+    debugfs_create_file("nvos_alloc", S_IRUGO, NULL, NULL,
+        &s_NvOsAllocFops);
+    return 0;
+}
+late_initcall(NvOsAllocDebugInit);
+#endif
+
 void *NvOsExecAlloc(size_t size)
 {
     return vmalloc_exec( size );
@@ -1674,12 +1903,12 @@ void NvOsTraceLogEnd(void)
 #if NV_DEBUG
 void *NvOsAllocLeak( size_t size, const char *f, int l )
 {
-    return NvOsAlloc( size );
+    return NvOsAllocFrom( size, __builtin_return_address(0) );
 }
 
 void *NvOsReallocLeak( void *ptr, size_t size, const char *f, int l )
 {
-    return NvOsRealloc( ptr, size );
+    return NvOsReallocFrom( ptr, size, __builtin_return_address(0) );
 }
 
 void NvOsFreeLeak( void *ptr, const char *f, int l )
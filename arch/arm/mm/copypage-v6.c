@@ -36,14 +36,13 @@ static DEFINE_SPINLOCK(v6_lock);
 static void v6_copy_user_highpage_nonaliasing(struct page *to,
 	struct page *from, unsigned long vaddr, struct vm_area_struct *vma)
 {
-	void *kto, *kfrom;
-
-	kfrom = kmap_atomic(from, KM_USER0);
-	kto = kmap_atomic(to, KM_USER1);
-	copy_page(kto, kfrom);
-	__cpuc_flush_dcache_area(kto, PAGE_SIZE);
-	kunmap_atomic(kto, KM_USER1);
-	kunmap_atomic(kfrom, KM_USER0);
+	struct page *pages[2] = { from, to };
+	void *addrs[2];
+
+	kmap_atomic_pages(pages, addrs, 2, KM_USER0);
+	copy_page(addrs[1], addrs[0]);
+	__cpuc_flush_dcache_area(addrs[1], PAGE_SIZE);
+	kunmap_atomic_pages(addrs, 2, KM_USER0);
 }
 
 /*
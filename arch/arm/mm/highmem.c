@@ -114,6 +114,88 @@ void *kmap_atomic_pfn(unsigned long pfn, enum km_type type)
 	return (void *)vaddr;
 }
 
+/*
+ * Map nr highmem pages into consecutive slots starting at type, with a
+ * single TLB maintenance operation over the slots that changed instead
+ * of one per page.  A slot that still maps the same page from its last
+ * use is not touched at all.
+ */
+void kmap_atomic_pages(struct page **pages, void **addrs, int nr,
+		       enum km_type type)
+{
+	unsigned long vaddr, start = 0, end = 0;
+	unsigned int idx;
+	pte_t pte;
+	int i;
+
+	BUG_ON(type + nr > KM_TYPE_NR);
+
+	pagefault_disable();
+	idx = type + KM_TYPE_NR * smp_processor_id();
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		if (!PageHighMem(page)) {
+			addrs[i] = page_address(page);
+			continue;
+		}
+
+		debug_kmap_atomic(type + i);
+
+		addrs[i] = kmap_high_get(page);
+		if (addrs[i])
+			continue;
+
+		vaddr = __fix_to_virt(FIX_KMAP_BEGIN + idx + i);
+#ifdef CONFIG_DEBUG_HIGHMEM
+		BUG_ON(!pte_none(*(TOP_PTE(vaddr))));
+#endif
+		addrs[i] = (void *)vaddr;
+		pte = mk_pte(page, kmap_prot);
+		if (pte_val(*TOP_PTE(vaddr)) == pte_val(pte))
+			continue;
+		set_pte_ext(TOP_PTE(vaddr), pte, 0);
+		if (!end)
+			start = vaddr;
+		end = vaddr + PAGE_SIZE;
+	}
+	if (end)
+		local_flush_tlb_kernel_range(start, end);
+}
+EXPORT_SYMBOL(kmap_atomic_pages);
+
+void kunmap_atomic_pages(void **addrs, int nr, enum km_type type)
+{
+	unsigned int idx = type + KM_TYPE_NR * smp_processor_id();
+	unsigned long vaddr, start = 0, end = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		vaddr = (unsigned long)addrs[i] & PAGE_MASK;
+		if (addrs[i] >= (void *)FIXADDR_START) {
+			if (cache_is_vivt())
+				__cpuc_flush_dcache_area((void *)vaddr,
+							 PAGE_SIZE);
+#ifdef CONFIG_DEBUG_HIGHMEM
+			BUG_ON(vaddr != __fix_to_virt(FIX_KMAP_BEGIN + idx + i));
+			set_pte_ext(TOP_PTE(vaddr), __pte(0), 0);
+			if (!end)
+				start = vaddr;
+			end = vaddr + PAGE_SIZE;
+#endif
+		} else if (vaddr >= PKMAP_ADDR(0) &&
+			   vaddr < PKMAP_ADDR(LAST_PKMAP)) {
+			/* this address was obtained through kmap_high_get() */
+			kunmap_high(pte_page(pkmap_page_table[PKMAP_NR(vaddr)]));
+		}
+	}
+	if (end)
+		local_flush_tlb_kernel_range(start, end);
+	(void) idx;  /* to kill a warning */
+	pagefault_enable();
+}
+EXPORT_SYMBOL(kunmap_atomic_pages);
+
 struct page *kmap_atomic_to_page(const void *ptr)
 {
 	unsigned long vaddr = (unsigned long)ptr;
@@ -212,3 +294,78 @@ void kunmap_high_l1_vipt(struct page *page, pte_t saved_pte)
 }
 
 #endif  /* CONFIG_CPU_CACHE_VIPT */
+
+#ifdef CONFIG_DEBUG_MICROBENCH
+
+#include <linux/microbench.h>
+#include <linux/sched.h>
+
+/*
+ * /sys/kernel/debug/bench/kmap_pages copies between highmem pages,
+ * mapping each pair with two kmap_atomic() calls and then with one
+ * kmap_atomic_pages() call, and reports the time taken per page copied
+ * for both.  The pages are rotated so that every copy needs new
+ * mappings.
+ */
+#define KMAP_BENCH_PAGES	16
+#define KMAP_BENCH_LOOPS	10000
+
+static u64 kmap_bench_copy(struct page **pages, bool batched)
+{
+	void *addrs[2];
+	u64 start;
+	int i;
+
+	start = sched_clock();
+	for (i = 0; i < KMAP_BENCH_LOOPS; i++) {
+		struct page **pair = &pages[2 * (i % KMAP_BENCH_PAGES)];
+
+		if (batched) {
+			kmap_atomic_pages(pair, addrs, 2, KM_USER0);
+			copy_page(addrs[1], addrs[0]);
+			kunmap_atomic_pages(addrs, 2, KM_USER0);
+		} else {
+			addrs[0] = kmap_atomic(pair[0], KM_USER0);
+			addrs[1] = kmap_atomic(pair[1], KM_USER1);
+			copy_page(addrs[1], addrs[0]);
+			kunmap_atomic(addrs[1], KM_USER1);
+			kunmap_atomic(addrs[0], KM_USER0);
+		}
+	}
+	return sched_clock() - start;
+}
+
+static int kmap_bench_run(char *buf, size_t size)
+{
+	struct page *pages[2 * KMAP_BENCH_PAGES];
+	int i, len = -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(pages); i++) {
+		pages[i] = alloc_page(GFP_HIGHUSER);
+		if (!pages[i])
+			goto out;
+	}
+
+	len = microbench_print(buf, size, "kmap_atomic",
+			       kmap_bench_copy(pages, false),
+			       KMAP_BENCH_LOOPS, "page");
+	len += microbench_print(buf + len, size - len, "kmap_atomic_pages",
+				kmap_bench_copy(pages, true),
+				KMAP_BENCH_LOOPS, "page");
+out:
+	while (i--)
+		__free_page(pages[i]);
+	return len;
+}
+
+static struct microbench kmap_bench = {
+	.name	= "kmap_pages",
+	.run	= kmap_bench_run,
+};
+
+static int __init kmap_bench_init(void)
+{
+	return microbench_register(&kmap_bench);
+}
+late_initcall(kmap_bench_init);
+#endif /* CONFIG_DEBUG_MICROBENCH */
@@ -91,6 +91,20 @@ static const int bfq_async_charge_factor = 10;
 static const int bfq_timeout_sync = HZ / 8;
 static int bfq_timeout_async = HZ / 25;
 
+/*
+ * Weight raising: sync queues of interactive tasks (newly created, or
+ * backlogged after being idle for a while) and of soft real-time tasks
+ * (asking for service at a low rate) have their weight multiplied by
+ * bfq_raising_coeff for a limited time, in jiffies, so that they are served
+ * quickly even when competing with greedy readers or writers.  The soft
+ * real-time rate threshold is in sectors/sec.
+ */
+static const int bfq_raising_coeff = 20;
+static const int bfq_raising_max_time = HZ * 15 / 2;
+static const int bfq_raising_rt_max_time = HZ * 3 / 10;
+static const int bfq_raising_min_idle_time = 2 * HZ;
+static const int bfq_raising_max_softrt_rate = 7000;
+
 struct kmem_cache *bfq_pool;
 struct kmem_cache *bfq_ioc_pool;
 
@@ -344,6 +358,60 @@ static void bfq_updated_next_req(struct bfq_data *bfqd,
 	bfq_activate_bfqq(bfqd, bfqq);
 }
 
+/* A time instant surely in the past, as seen by time_before() et al. */
+static inline unsigned long bfq_smallest_from_now(void)
+{
+	return jiffies - MAX_JIFFY_OFFSET;
+}
+
+/* A time instant surely in the future, as seen by time_before() et al. */
+static inline unsigned long bfq_infinity_from_now(void)
+{
+	return jiffies + MAX_JIFFY_OFFSET;
+}
+
+/*
+ * Start, extend or stop weight raising for @bfqq, which is becoming
+ * backlogged.  @idle_for_long_time means that the queue has been idle
+ * for long (or has just been created), @soft_rt that its last busy
+ * period asked for service at a low enough rate.
+ */
+static void bfq_update_raising(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			       int idle_for_long_time, int soft_rt)
+{
+	if (bfqq->raising_coeff == 1) {
+		if (!idle_for_long_time && !soft_rt)
+			return;
+		bfqq->raising_coeff = bfqd->bfq_raising_coeff;
+		bfqq->raising_cur_max_time = idle_for_long_time ?
+			bfqd->bfq_raising_max_time :
+			bfqd->bfq_raising_rt_max_time;
+		bfqq->last_rais_start_finish = jiffies;
+		bfq_log_bfqq(bfqd, bfqq, "wrais starting, max time %u msec",
+			     jiffies_to_msecs(bfqq->raising_cur_max_time));
+	} else if (idle_for_long_time) {
+		/* A new interactive burst: restart a full raising period. */
+		bfqq->raising_cur_max_time = bfqd->bfq_raising_max_time;
+		bfqq->last_rais_start_finish = jiffies;
+	} else if (bfqq->raising_cur_max_time ==
+		   bfqd->bfq_raising_rt_max_time && !soft_rt) {
+		/* No longer soft real-time, stop raising it. */
+		bfqq->raising_coeff = 1;
+		bfqq->last_rais_start_finish = jiffies;
+		bfq_log_bfqq(bfqd, bfqq, "wrais ending, no longer soft rt");
+	} else if (soft_rt &&
+		   time_before(bfqq->last_rais_start_finish +
+			       bfqq->raising_cur_max_time,
+			       jiffies + bfqd->bfq_raising_rt_max_time)) {
+		/*
+		 * Still soft real-time near the end of the period (possibly
+		 * an interactive one): let it go on for a soft rt period.
+		 */
+		bfqq->raising_cur_max_time = bfqd->bfq_raising_rt_max_time;
+		bfqq->last_rais_start_finish = jiffies;
+	}
+}
+
 static void bfq_add_rq_rb(struct request *rq)
 {
 	struct bfq_queue *bfqq = RQ_BFQQ(rq);
@@ -370,26 +438,25 @@ static void bfq_add_rq_rb(struct request *rq)
 	bfqq->next_rq = next_rq;
 
 	if (!bfq_bfqq_busy(bfqq)) {
+		unsigned int old_raising_coeff = bfqq->raising_coeff;
+		int idle_for_long_time = time_is_before_jiffies(
+			bfqq->budget_timeout + bfqd->bfq_raising_min_idle_time);
+		int soft_rt = bfqd->bfq_raising_max_softrt_rate > 0 &&
+			time_is_before_jiffies(bfqq->soft_rt_next_start);
+
 		entity->budget = max_t(bfq_service_t, bfqq->max_budget,
 				       bfq_serv_to_charge(next_rq, bfqq));
 
-		/*
-		 * If the queue is not being boosted and has been idle
-		 * for enough time, start a boosting period
-		 */
-		if (bfqd->low_latency && bfqq->high_weight_budget == 0) {
-			if(bfqq->last_activation_time + BFQ_MIN_ACT_INTERVAL <
-			   jiffies_to_msecs(jiffies)) {
-				bfqq->high_weight_budget = BFQ_BOOST_BUDGET;
+		/* Async queues (e.g., writeback) are never raised. */
+		if (bfqd->low_latency && bfq_bfqq_sync(bfqq)) {
+			bfq_update_raising(bfqd, bfqq, idle_for_long_time,
+					   soft_rt);
+			if (old_raising_coeff != bfqq->raising_coeff)
 				entity->ioprio_changed = 1;
-				bfq_log_bfqq(bfqd, bfqq,
-					     "wboost starting at %lu msec",
-					     bfqq->last_activation_time);
-			}
-			bfqq->last_activation_time =
-				jiffies_to_msecs(jiffies);
 		}
 
+		bfqq->last_idle_bklogged = jiffies;
+		bfqq->service_from_backlogged = 0;
 		bfq_add_bfqq_busy(bfqd, bfqq);
 	} else
 		bfq_updated_next_req(bfqd, bfqq);
@@ -965,6 +1032,15 @@ static int bfq_update_peak_rate(struct bfq_data *bfqd, struct bfq_queue *bfqq,
  * schedule the former on a timeslice basis, without violating the
  * service domain guarantees of the latter.
  */
+static inline unsigned long bfq_bfqq_softrt_next_start(struct bfq_data *bfqd,
+						       struct bfq_queue *bfqq)
+{
+	return max(bfqq->last_idle_bklogged +
+		   HZ * bfqq->service_from_backlogged /
+		   bfqd->bfq_raising_max_softrt_rate,
+		   jiffies + bfqd->bfq_slice_idle + 4);
+}
+
 static void bfq_bfqq_expire(struct bfq_data *bfqd,
 			    struct bfq_queue *bfqq,
 			    int compensate,
@@ -997,6 +1073,21 @@ static void bfq_bfqq_expire(struct bfq_data *bfqd,
 		"expire (%d, slow %d, num_disp %d, idle_win %d)", reason, slow,
 		bfqq->dispatched, bfq_bfqq_idle_window(bfqq));
 
+	/*
+	 * If the queue emptied without timing out, it will be deemed soft
+	 * real-time should it become backlogged again not before the time
+	 * needed to receive, at bfq_raising_max_softrt_rate, the service it
+	 * has got since it last became backlogged.
+	 */
+	if (bfqd->low_latency && bfqd->bfq_raising_max_softrt_rate > 0) {
+		if (reason != BFQ_BFQQ_BUDGET_TIMEOUT &&
+		    RB_EMPTY_ROOT(&bfqq->sort_list))
+			bfqq->soft_rt_next_start =
+				bfq_bfqq_softrt_next_start(bfqd, bfqq);
+		else
+			bfqq->soft_rt_next_start = bfq_infinity_from_now();
+	}
+
 	/* Increase, decrease or leave budget unchanged according to reason */
 	__bfq_bfqq_recalc_budget(bfqd, bfqq, reason);
 	__bfq_bfqq_expire(bfqd, bfqq);
@@ -1124,27 +1215,23 @@ static int __bfq_dispatch_requests(struct bfq_data *bfqd,
 		bfq_bfqq_served(bfqq, service_to_charge);
 		bfq_dispatch_insert(bfqd->queue, rq);
 
-		if (bfqq->high_weight_budget > 0) { /* queue is being boosted */
+		bfqq->service_from_backlogged += service_to_charge;
+
+		/*
+		 * Stop weight raising once the current raising period is
+		 * over, or if low_latency has been switched off meanwhile.
+		 */
+		if (bfqq->raising_coeff > 1 &&
+		    (!bfqd->low_latency ||
+		     time_is_before_jiffies(bfqq->last_rais_start_finish +
+					    bfqq->raising_cur_max_time))) {
 			struct bfq_entity *entity = &bfqq->entity;
 
-			bfq_log_bfqq(bfqd, bfqq, "busy period dur %llu msec, "
-				     "old highwbudg %lu",
-				     jiffies_to_msecs(jiffies) -
-				     bfqq->last_activation_time,
-				     bfqq->high_weight_budget);
-			/*
-			 * Decrease the budget for weight boosting by
-			 * the just received service, or, if too much
-			 * time has elapsed from the beginning of this
-			 * boosting period, stop it
-			 */
-			if (jiffies_to_msecs(jiffies) -
-			    bfqq->last_activation_time <= BFQ_BOOST_TIMEOUT
-			    &&
-			    bfqq->high_weight_budget > service_to_charge)
-				bfqq->high_weight_budget -= service_to_charge;
-			else
-				bfqq->high_weight_budget = 0;
+			bfq_log_bfqq(bfqd, bfqq, "wrais ending after %u msec",
+				     jiffies_to_msecs(jiffies -
+					bfqq->last_rais_start_finish));
+			bfqq->raising_coeff = 1;
+			bfqq->last_rais_start_finish = jiffies;
 			entity->ioprio_changed = 1;
 			__bfq_entity_update_weight_prio(
 				bfq_entity_service_tree(entity),
@@ -1453,8 +1540,11 @@ retry:
 		bfqq->max_budget = (2 * bfq_max_budget(bfqd)) / 3;
 		bfqq->pid = current->pid;
 
-		bfqq->last_activation_time = 0;
-		bfqq->high_weight_budget = 0;
+		/* A new queue looks idle for long, i.e., interactive. */
+		bfqq->budget_timeout = bfq_smallest_from_now();
+		bfqq->raising_coeff = 1;
+		bfqq->last_rais_start_finish = 0;
+		bfqq->soft_rt_next_start = bfq_infinity_from_now();
 
 		bfq_log_bfqq(bfqd, bfqq, "allocated");
 	}
@@ -2038,6 +2128,12 @@ static void *bfq_init_queue(struct request_queue *q)
 
 	bfqd->low_latency = true;
 
+	bfqd->bfq_raising_coeff = bfq_raising_coeff;
+	bfqd->bfq_raising_max_time = bfq_raising_max_time;
+	bfqd->bfq_raising_rt_max_time = bfq_raising_rt_max_time;
+	bfqd->bfq_raising_min_idle_time = bfq_raising_min_idle_time;
+	bfqd->bfq_raising_max_softrt_rate = bfq_raising_max_softrt_rate;
+
 	return bfqd;
 }
 
@@ -2101,6 +2197,13 @@ SHOW_FUNCTION(bfq_max_budget_async_rq_show, bfqd->bfq_max_budget_async_rq, 0);
 SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout[SYNC], 1);
 SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout[ASYNC], 1);
 SHOW_FUNCTION(bfq_low_latency_show, bfqd->low_latency, 0);
+SHOW_FUNCTION(bfq_raising_coeff_show, bfqd->bfq_raising_coeff, 0);
+SHOW_FUNCTION(bfq_raising_max_time_show, bfqd->bfq_raising_max_time, 1);
+SHOW_FUNCTION(bfq_raising_rt_max_time_show, bfqd->bfq_raising_rt_max_time, 1);
+SHOW_FUNCTION(bfq_raising_min_idle_time_show, bfqd->bfq_raising_min_idle_time,
+	1);
+SHOW_FUNCTION(bfq_raising_max_softrt_rate_show,
+	bfqd->bfq_raising_max_softrt_rate, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -2133,6 +2236,16 @@ STORE_FUNCTION(bfq_max_budget_async_rq_store, &bfqd->bfq_max_budget_async_rq,
 		1, INT_MAX, 0);
 STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout[ASYNC], 0,
 		INT_MAX, 1);
+STORE_FUNCTION(bfq_raising_coeff_store, &bfqd->bfq_raising_coeff, 1,
+		BFQ_MAX_WEIGHT, 0);
+STORE_FUNCTION(bfq_raising_max_time_store, &bfqd->bfq_raising_max_time, 0,
+		INT_MAX, 1);
+STORE_FUNCTION(bfq_raising_rt_max_time_store, &bfqd->bfq_raising_rt_max_time,
+		0, INT_MAX, 1);
+STORE_FUNCTION(bfq_raising_min_idle_time_store,
+		&bfqd->bfq_raising_min_idle_time, 0, INT_MAX, 1);
+STORE_FUNCTION(bfq_raising_max_softrt_rate_store,
+		&bfqd->bfq_raising_max_softrt_rate, 0, INT_MAX, 0);
 #undef STORE_FUNCTION
 
 static inline bfq_service_t bfq_estimated_max_budget(struct bfq_data *bfqd)
@@ -2213,6 +2326,11 @@ static struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(timeout_sync),
 	BFQ_ATTR(timeout_async),
 	BFQ_ATTR(low_latency),
+	BFQ_ATTR(raising_coeff),
+	BFQ_ATTR(raising_max_time),
+	BFQ_ATTR(raising_rt_max_time),
+	BFQ_ATTR(raising_min_idle_time),
+	BFQ_ATTR(raising_max_softrt_rate),
 	__ATTR_NULL
 };
 
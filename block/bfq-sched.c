@@ -134,9 +134,8 @@ static inline void bfq_calc_finish(struct bfq_entity *entity,
 
 	if (bfqq != NULL) {
 		bfq_log_bfqq(bfqq->bfqd, bfqq,
-			"calc_finish: serv %lu, w %lu, hi-budg %lu",
-			service, entity->weight,
-			bfqq->high_weight_budget);
+			"calc_finish: serv %lu, w %lu, rais coeff %u",
+			service, entity->weight, bfqq->raising_coeff);
 		bfq_log_bfqq(bfqq->bfqd, bfqq,
 			"calc_finish: start %llu, finish %llu, delta %llu",
 			entity->start, entity->finish,
@@ -518,17 +517,14 @@ __bfq_entity_update_weight_prio(struct bfq_service_tree *old_st,
 	struct bfq_service_tree *new_st = old_st;
 
 	if (entity->ioprio_changed) {
-		int new_boost_coeff = 1;
+		unsigned int new_raising_coeff = 1;
 		struct bfq_queue *bfqq = bfq_entity_to_bfqq(entity);
 
 		if (bfqq != NULL) {
-			new_boost_coeff +=
-				bfqq->high_weight_budget * BFQ_BOOST_COEFF /
-				BFQ_BOOST_BUDGET;
+			new_raising_coeff = bfqq->raising_coeff;
 			bfq_log_bfqq(bfqq->bfqd, bfqq,
-				"update_w_prio: wght %lu, hi-budg %lu, coef %d",
-				entity->weight, bfqq->high_weight_budget,
-				new_boost_coeff);
+				"update_w_prio: wght %lu, rais coeff %u",
+				entity->weight, new_raising_coeff);
 		}
 
 		BUG_ON(old_st->wsum < entity->weight);
@@ -557,7 +553,7 @@ __bfq_entity_update_weight_prio(struct bfq_service_tree *old_st,
 		 * when entity->finish <= old_st->vtime).
 		 */
 		new_st = bfq_entity_service_tree(entity);
-		entity->weight = entity->orig_weight * new_boost_coeff;
+		entity->weight = entity->orig_weight * new_raising_coeff;
 		new_st->wsum += entity->weight;
 
 		if (new_st != old_st)
@@ -28,16 +28,6 @@
 #define BFQ_DEFAULT_GRP_IOPRIO	0
 #define BFQ_DEFAULT_GRP_CLASS	IOPRIO_CLASS_BE
 
-/* Constants used in weight boosting (in its turn used to reduce latencies): */
-/* max factor by which the weight of a boosted queue is multiplied */
-#define BFQ_BOOST_COEFF	10
-/* max number of sectors that can be served during a boosting period */
-#define BFQ_BOOST_BUDGET	49152
-/* max duration of a boosting period, msec */
-#define BFQ_BOOST_TIMEOUT	6000
-/* min idle period after which boosting may be reactivated for a queue, msec */
-#define BFQ_MIN_ACT_INTERVAL	20000
-
 typedef u64 bfq_timestamp_t;
 typedef unsigned long bfq_service_t;
 
@@ -218,6 +208,18 @@ struct bfq_group;
  *               they are charged for the whole allocated budget, to try
  *               to preserve a behavior reasonably fair among them, but
  *               without service-domain guarantees).
+ * @low_latency: if set to true, low-latency heuristics are enabled.
+ * @bfq_raising_coeff: maximum factor by which the weight of a weight-raised
+ *                     queue is multiplied.
+ * @bfq_raising_max_time: maximum duration of a weight-raising period for
+ *                        an interactive queue (jiffies).
+ * @bfq_raising_rt_max_time: maximum duration of a weight-raising period for
+ *                           a soft real-time queue (jiffies).
+ * @bfq_raising_min_idle_time: minimum idle period after which weight-raising
+ *                             may be reactivated for a queue (jiffies).
+ * @bfq_raising_max_softrt_rate: max service rate, in sectors/sec, that a
+ *                               queue may ask for and still be deemed soft
+ *                               real-time (0 disables soft real-time raising).
  *
  * All the fields are protected by the @queue lock.
  */
@@ -267,6 +269,12 @@ struct bfq_data {
 	unsigned int bfq_timeout[2];
 
 	bool low_latency;
+
+	unsigned int bfq_raising_coeff;
+	unsigned int bfq_raising_max_time;
+	unsigned int bfq_raising_rt_max_time;
+	unsigned int bfq_raising_min_idle_time;
+	unsigned int bfq_raising_max_softrt_rate;
 };
 
 /**
@@ -292,8 +300,15 @@ struct bfq_data {
  * @seek_mean: mean seek distance
  * @last_request_pos: position of the last request enqueued
  * @pid: pid of the process owning the queue, used for logging purposes.
- * @last_activation_time: time of the last (idle -> backlogged) transition
- * @high_weight_budget: number of sectors left to serve with boosted weight
+ * @last_rais_start_finish: start time of the current weight-raising period,
+ *                          or end time of the last one (jiffies).
+ * @raising_cur_max_time: duration of the current weight-raising period.
+ * @raising_coeff: current weight-raising coefficient (1 if not raised).
+ * @last_idle_bklogged: time of the last (idle -> backlogged) transition.
+ * @service_from_backlogged: service received since @last_idle_bklogged.
+ * @soft_rt_next_start: earliest time at which the queue, becoming backlogged
+ *                      again, still keeps its service rate low enough to be
+ *                      deemed soft real-time.
  *
  * A bfq_queue is a leaf request queue; it can be associated to an io_context
  * or more (if it is an async one).  @cgroup holds a reference to the
@@ -334,8 +349,12 @@ struct bfq_queue {
 
 	pid_t pid;
 
-	u64 last_activation_time;
-	bfq_service_t high_weight_budget;
+	unsigned long last_rais_start_finish;
+	unsigned long raising_cur_max_time;
+	unsigned int raising_coeff;
+	unsigned long last_idle_bklogged;
+	bfq_service_t service_from_backlogged;
+	unsigned long soft_rt_next_start;
 };
 
 enum bfqq_state_flags {
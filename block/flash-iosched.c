@@ -0,0 +1,464 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Derived from the deadline i/o scheduler,
+ *  Copyright (C) 2002 Jens Axboe <axboe@kernel.dk>
+ *
+ *  For eMMC/NAND storage, where seeking costs nothing: requests are
+ *  dispatched in arrival order, reads in batches ahead of writes, with
+ *  per-direction fifo deadlines, and no sorting, seek accounting or idling.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/log2.h>
+#include <linux/rbtree.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int read_expire = HZ / 4;  /* max time before a read is submitted. */
+static const int write_expire = 5 * HZ; /* ditto for writes, these limits are SOFT! */
+static const int read_batch = 16;       /* max # of reads dispatched in a row */
+static const int write_batch = 8;       /* ditto for writes */
+static const int writes_starved = 2;    /* max read batches while writes wait */
+
+/* batch sizes are binned by 1, 2-3, 4-7, 8-15 and 16+ requests */
+#define FLASH_BATCH_HIST	5
+
+struct flash_batch_stats {
+	unsigned long batches;
+	unsigned long requests;
+	unsigned int max;
+	unsigned long hist[FLASH_BATCH_HIST];
+};
+
+struct flash_data {
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * requests are present on both sort_list and fifo_list; sort_list
+	 * is only used to find merge candidates
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	int batch_dir;			/* data direction of current batch */
+	unsigned int batching;		/* requests dispatched in this batch */
+	unsigned int starved;		/* times reads have starved writes */
+
+	struct flash_batch_stats stats[2];
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int fifo_batch[2];
+	int writes_starved;
+	int front_merges;
+};
+
+static void flash_move_to_dispatch(struct flash_data *, struct request *);
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_to_dispatch(fd, __alias);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	flash_add_rq_rb(fd, rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[data_dir]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * back merges are found by the elevator core through its hash,
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void
+flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * flash_check_fifo returns 1 if the oldest request of direction ddir has
+ * expired, 0 otherwise. Requires !list_empty(&fd->fifo_list[ddir])
+ */
+static inline int flash_check_fifo(struct flash_data *fd, int ddir)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[ddir].next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * account the batch that just ended in the sysfs batch statistics
+ */
+static void flash_end_batch(struct flash_data *fd)
+{
+	struct flash_batch_stats *stats = &fd->stats[fd->batch_dir];
+
+	if (!fd->batching)
+		return;
+
+	stats->batches++;
+	stats->requests += fd->batching;
+	if (fd->batching > stats->max)
+		stats->max = fd->batching;
+	stats->hist[min_t(int, ilog2(fd->batching), FLASH_BATCH_HIST - 1)]++;
+	fd->batching = 0;
+}
+
+/*
+ * flash_dispatch_requests dispatches the oldest request of the current
+ * batch, or starts a new batch: reads unless writes have expired or have
+ * been starved for writes_starved read batches.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[READ]);
+	const int writes = !list_empty(&fd->fifo_list[WRITE]);
+	int data_dir = fd->batch_dir;
+
+	/*
+	 * go on with the current batch, unless it is full or it is a write
+	 * batch holding back an expired read
+	 */
+	if (fd->batching && fd->batching < fd->fifo_batch[data_dir] &&
+	    !list_empty(&fd->fifo_list[data_dir]) &&
+	    !(data_dir == WRITE && reads && flash_check_fifo(fd, READ)))
+		goto dispatch_request;
+
+	if (reads) {
+		if (writes && (flash_check_fifo(fd, WRITE) ||
+			       fd->starved++ >= fd->writes_starved))
+			goto dispatch_writes;
+
+		data_dir = READ;
+
+		goto new_batch;
+	}
+
+	/*
+	 * there are either no reads or writes have been starved
+	 */
+
+	if (writes) {
+dispatch_writes:
+		fd->starved = 0;
+
+		data_dir = WRITE;
+
+		goto new_batch;
+	}
+
+	return 0;
+
+new_batch:
+	flash_end_batch(fd);
+	fd->batch_dir = data_dir;
+
+dispatch_request:
+	/*
+	 * no sorting: the oldest request of the direction goes first
+	 */
+	fd->batching++;
+	flash_move_to_dispatch(fd, rq_entry_fifo(fd->fifo_list[data_dir].next));
+
+	return 1;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return list_empty(&fd->fifo_list[WRITE])
+		&& list_empty(&fd->fifo_list[READ]);
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->fifo_list[READ]));
+	BUG_ON(!list_empty(&fd->fifo_list[WRITE]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	INIT_LIST_HEAD(&fd->fifo_list[READ]);
+	INIT_LIST_HEAD(&fd->fifo_list[WRITE]);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->fifo_expire[READ] = read_expire;
+	fd->fifo_expire[WRITE] = write_expire;
+	fd->fifo_batch[READ] = read_batch;
+	fd->fifo_batch[WRITE] = write_batch;
+	fd->writes_starved = writes_starved;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[READ], 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(flash_read_batch_show, fd->fifo_batch[READ], 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->fifo_batch[WRITE], 0);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_read_batch_store, &fd->fifo_batch[READ], 1, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->fifo_batch[WRITE], 1, INT_MAX, 0);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, INT_MIN, INT_MAX, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+/*
+ * one line per direction: batches, requests, largest batch, then the
+ * number of batches of 1, 2-3, 4-7, 8-15 and 16+ requests.  Writing to
+ * the file clears the statistics.
+ */
+static ssize_t flash_batch_stats_show(struct elevator_queue *e, char *page)
+{
+	struct flash_data *fd = e->elevator_data;
+	ssize_t len = 0;
+	int dir, i;
+
+	for (dir = READ; dir <= WRITE; dir++) {
+		struct flash_batch_stats *stats = &fd->stats[dir];
+
+		len += sprintf(page + len, "%s %lu %lu %u",
+			       dir == READ ? "read" : "write", stats->batches,
+			       stats->requests, stats->max);
+		for (i = 0; i < FLASH_BATCH_HIST; i++)
+			len += sprintf(page + len, " %lu", stats->hist[i]);
+		len += sprintf(page + len, "\n");
+	}
+	return len;
+}
+
+static ssize_t flash_batch_stats_store(struct elevator_queue *e,
+				       const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	memset(fd->stats, 0, sizeof(fd->stats));
+	return count;
+}
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(read_expire),
+	FD_ATTR(write_expire),
+	FD_ATTR(read_batch),
+	FD_ATTR(write_batch),
+	FD_ATTR(writes_starved),
+	FD_ATTR(front_merges),
+	FD_ATTR(batch_stats),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
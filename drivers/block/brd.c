@@ -436,6 +436,7 @@ static struct brd_device *brd_alloc(int i)
 	blk_queue_ordered(brd->brd_queue, QUEUE_ORDERED_TAG, NULL);
 	blk_queue_max_sectors(brd->brd_queue, 1024);
 	blk_queue_bounce_limit(brd->brd_queue, BLK_BOUNCE_ANY);
+	brd->brd_queue->backing_dev_info.capabilities |= BDI_CAP_SYNCHRONOUS_IO;
 
 	disk = brd->brd_disk = alloc_disk(1 << part_shift);
 	if (!disk)
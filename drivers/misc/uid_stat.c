@@ -13,56 +13,129 @@
  *
  */
 
-#include <asm/atomic.h>
-
 #include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/hardirq.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
-#include <linux/spinlock.h>
 #include <linux/stat.h>
 #include <linux/uid_stat.h>
+#include <linux/vmalloc.h>
+#include <net/dst.h>
+#include <net/sock.h>
+
+/*
+ * Uids are kept in a hash table, each with a list of the interfaces it
+ * has used and per cpu counters for each of those.  Entries are only
+ * ever added, under uid_mutex, so the packet path looks them up under
+ * rcu_read_lock() and bumps the counters of the local cpu without
+ * taking any lock or touching a shared cache line; readers fold the
+ * counters of all cpus.
+ */
+#define UID_HASH_BITS	6
 
-static DEFINE_SPINLOCK(uid_lock);
-static LIST_HEAD(uid_list);
+static DEFINE_MUTEX(uid_mutex);
+static struct hlist_head uid_hash[1 << UID_HASH_BITS];
+static unsigned int uid_iface_count;
 static struct proc_dir_entry *parent;
 
-struct uid_stat {
+struct uid_stat_cpu {
+	seqcount_t seq;		/* 64 bit counters are not atomic */
+	u64 rcv_bytes;
+	u64 snd_bytes;
+	u64 rcv_packets;
+	u64 snd_packets;
+};
+
+struct uid_stat_iface {
 	struct list_head link;
+	int ifindex;
+	struct uid_stat_cpu *stats;	/* per cpu */
+};
+
+struct uid_stat {
+	struct hlist_node node;
 	uid_t uid;
-	atomic_t tcp_rcv;
-	atomic_t tcp_snd;
+	struct list_head ifaces;
 };
 
-static struct uid_stat *find_uid_stat(uid_t uid) {
-	unsigned long flags;
+static struct uid_stat *find_uid_stat(uid_t uid)
+{
 	struct uid_stat *entry;
+	struct hlist_node *pos;
 
-	spin_lock_irqsave(&uid_lock, flags);
-	list_for_each_entry(entry, &uid_list, link) {
-		if (entry->uid == uid) {
-			spin_unlock_irqrestore(&uid_lock, flags);
+	hlist_for_each_entry_rcu(entry, pos,
+				 &uid_hash[hash_32(uid, UID_HASH_BITS)], node) {
+		if (entry->uid == uid)
 			return entry;
-		}
 	}
-	spin_unlock_irqrestore(&uid_lock, flags);
 	return NULL;
 }
 
+static struct uid_stat_iface *find_iface(struct uid_stat *entry, int ifindex)
+{
+	struct uid_stat_iface *iface;
+
+	list_for_each_entry_rcu(iface, &entry->ifaces, link) {
+		if (iface->ifindex == ifindex)
+			return iface;
+	}
+	return NULL;
+}
+
+/* Sum of the counters of iface over all cpus */
+static void fold_iface(struct uid_stat_iface *iface, struct uid_stat_record *rec)
+{
+	struct uid_stat_cpu *s, snap;
+	unsigned seq;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		s = per_cpu_ptr(iface->stats, cpu);
+		do {
+			seq = read_seqcount_begin(&s->seq);
+			snap = *s;
+		} while (read_seqcount_retry(&s->seq, seq));
+		rec->rcv_bytes += snap.rcv_bytes;
+		rec->snd_bytes += snap.snd_bytes;
+		rec->rcv_packets += snap.rcv_packets;
+		rec->snd_packets += snap.snd_packets;
+	}
+}
+
+static void fold_uid(struct uid_stat *entry, struct uid_stat_record *rec)
+{
+	struct uid_stat_iface *iface;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->uid = entry->uid;
+	rcu_read_lock();
+	list_for_each_entry_rcu(iface, &entry->ifaces, link)
+		fold_iface(iface, rec);
+	rcu_read_unlock();
+}
+
 static int tcp_snd_read_proc(char *page, char **start, off_t off,
 				int count, int *eof, void *data)
 {
 	int len;
-	unsigned int bytes;
+	struct uid_stat_record rec;
 	char *p = page;
 	struct uid_stat *uid_entry = (struct uid_stat *) data;
 	if (!data)
 		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_snd) + INT_MIN);
-	p += sprintf(p, "%u\n", bytes);
+	fold_uid(uid_entry, &rec);
+	p += sprintf(p, "%llu\n", (unsigned long long)rec.snd_bytes);
 	len = (p - page) - off;
 	*eof = (len <= count) ? 1 : 0;
 	*start = page + off;
@@ -73,14 +146,14 @@ static int tcp_rcv_read_proc(char *page, char **start, off_t off,
 				int count, int *eof, void *data)
 {
 	int len;
-	unsigned int bytes;
+	struct uid_stat_record rec;
 	char *p = page;
 	struct uid_stat *uid_entry = (struct uid_stat *) data;
 	if (!data)
 		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_rcv) + INT_MIN);
-	p += sprintf(p, "%u\n", bytes);
+	fold_uid(uid_entry, &rec);
+	p += sprintf(p, "%llu\n", (unsigned long long)rec.rcv_bytes);
 	len = (p - page) - off;
 	*eof = (len <= count) ? 1 : 0;
 	*start = page + off;
@@ -88,24 +161,19 @@ static int tcp_rcv_read_proc(char *page, char **start, off_t off,
 }
 
 /* Create a new entry for tracking the specified uid. */
-static struct uid_stat *create_stat(uid_t uid) {
-	unsigned long flags;
+static struct uid_stat *create_stat(uid_t uid)
+{
 	char uid_s[32];
 	struct uid_stat *new_uid;
 	struct proc_dir_entry *entry;
 
-	/* Create the uid stat struct and append it to the list. */
 	if ((new_uid = kmalloc(sizeof(struct uid_stat), GFP_KERNEL)) == NULL)
 		return NULL;
 
 	new_uid->uid = uid;
-	/* Counters start at INT_MIN, so we can track 4GB of network traffic. */
-	atomic_set(&new_uid->tcp_rcv, INT_MIN);
-	atomic_set(&new_uid->tcp_snd, INT_MIN);
-
-	spin_lock_irqsave(&uid_lock, flags);
-	list_add_tail(&new_uid->link, &uid_list);
-	spin_unlock_irqrestore(&uid_lock, flags);
+	INIT_LIST_HEAD(&new_uid->ifaces);
+	hlist_add_head_rcu(&new_uid->node,
+			   &uid_hash[hash_32(uid, UID_HASH_BITS)]);
 
 	sprintf(uid_s, "%d", uid);
 	entry = proc_mkdir(uid_s, parent);
@@ -120,26 +188,169 @@ static struct uid_stat *create_stat(uid_t uid) {
 	return new_uid;
 }
 
-int update_tcp_snd(uid_t uid, int size) {
+/* Find or create the counters of uid on ifindex, called outside rcu. */
+static struct uid_stat_iface *create_iface(uid_t uid, int ifindex)
+{
 	struct uid_stat *entry;
+	struct uid_stat_iface *iface = NULL;
+	int cpu;
+
+	/* Creating the proc entries and per cpu counters may sleep */
+	if (in_interrupt())
+		return NULL;
+
+	mutex_lock(&uid_mutex);
 	if ((entry = find_uid_stat(uid)) == NULL &&
-		((entry = create_stat(uid)) == NULL)) {
-			return -1;
+		((entry = create_stat(uid)) == NULL))
+		goto out;
+	if ((iface = find_iface(entry, ifindex)) != NULL)
+		goto out;
+
+	if ((iface = kmalloc(sizeof(*iface), GFP_KERNEL)) == NULL)
+		goto out;
+	iface->ifindex = ifindex;
+	iface->stats = alloc_percpu(struct uid_stat_cpu);
+	if (!iface->stats) {
+		kfree(iface);
+		iface = NULL;
+		goto out;
+	}
+	for_each_possible_cpu(cpu)
+		seqcount_init(&per_cpu_ptr(iface->stats, cpu)->seq);
+	list_add_tail_rcu(&iface->link, &entry->ifaces);
+	uid_iface_count++;
+out:
+	mutex_unlock(&uid_mutex);
+	return iface;
+}
+
+/* Interface of the route cached on sk, 0 if there is none */
+static int sk_ifindex(struct sock *sk)
+{
+	struct dst_entry *dst;
+	int ifindex;
+
+	if (!sk)
+		return 0;
+	if ((ifindex = sk->sk_bound_dev_if) != 0)
+		return ifindex;
+
+	read_lock(&sk->sk_dst_lock);
+	dst = __sk_dst_get(sk);
+	if (dst && dst->dev)
+		ifindex = dst->dev->ifindex;
+	read_unlock(&sk->sk_dst_lock);
+	return ifindex;
+}
+
+static int update_stat(uid_t uid, struct sock *sk, int size, int packets,
+		       int snd)
+{
+	struct uid_stat *entry;
+	struct uid_stat_iface *iface = NULL;
+	struct uid_stat_cpu *s;
+	int ifindex = sk_ifindex(sk);
+
+	rcu_read_lock();
+	if ((entry = find_uid_stat(uid)) != NULL)
+		iface = find_iface(entry, ifindex);
+	rcu_read_unlock();
+
+	/* Entries are never freed, so iface stays valid outside rcu */
+	if (!iface && (iface = create_iface(uid, ifindex)) == NULL)
+		return -1;
+
+	/* tcp_read_sock() may also account from softirq context */
+	local_bh_disable();
+	s = per_cpu_ptr(iface->stats, smp_processor_id());
+	write_seqcount_begin(&s->seq);
+	if (snd) {
+		s->snd_bytes += size;
+		s->snd_packets += packets;
+	} else {
+		s->rcv_bytes += size;
+		s->rcv_packets += packets;
 	}
-	atomic_add(size, &entry->tcp_snd);
+	write_seqcount_end(&s->seq);
+	local_bh_enable();
 	return 0;
 }
 
-int update_tcp_rcv(uid_t uid, int size) {
+int update_tcp_snd(uid_t uid, struct sock *sk, int size, int packets)
+{
+	return update_stat(uid, sk, size, packets, 1);
+}
+
+int update_tcp_rcv(uid_t uid, struct sock *sk, int size, int packets)
+{
+	return update_stat(uid, sk, size, packets, 0);
+}
+
+/*
+ * /proc/uid_stat/all: the counters of every uid and interface as an
+ * array of struct uid_stat_record, snapshotted when the file is opened.
+ */
+struct uid_stat_snapshot {
+	size_t len;
+	struct uid_stat_record rec[0];
+};
+
+static int all_open(struct inode *inode, struct file *file)
+{
+	struct uid_stat_snapshot *snap;
 	struct uid_stat *entry;
-	if ((entry = find_uid_stat(uid)) == NULL &&
-		((entry = create_stat(uid)) == NULL)) {
-			return -1;
+	struct uid_stat_iface *iface;
+	struct hlist_node *pos;
+	struct uid_stat_record *rec;
+	int i;
+
+	mutex_lock(&uid_mutex);
+	snap = vmalloc(sizeof(*snap) + uid_iface_count * sizeof(*rec));
+	if (!snap) {
+		mutex_unlock(&uid_mutex);
+		return -ENOMEM;
 	}
-	atomic_add(size, &entry->tcp_rcv);
+
+	rec = snap->rec;
+	for (i = 0; i < ARRAY_SIZE(uid_hash); i++) {
+		hlist_for_each_entry(entry, pos, &uid_hash[i], node) {
+			list_for_each_entry(iface, &entry->ifaces, link) {
+				memset(rec, 0, sizeof(*rec));
+				rec->uid = entry->uid;
+				rec->ifindex = iface->ifindex;
+				fold_iface(iface, rec);
+				rec++;
+			}
+		}
+	}
+	snap->len = (char *)rec - (char *)snap->rec;
+	mutex_unlock(&uid_mutex);
+
+	file->private_data = snap;
+	return 0;
+}
+
+static ssize_t all_read(struct file *file, char __user *buf, size_t count,
+			loff_t *ppos)
+{
+	struct uid_stat_snapshot *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, snap->rec, snap->len);
+}
+
+static int all_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
 	return 0;
 }
 
+static const struct file_operations all_fops = {
+	.open		= all_open,
+	.read		= all_read,
+	.llseek		= default_llseek,
+	.release	= all_release,
+};
+
 static int __init uid_stat_init(void)
 {
 	parent = proc_mkdir("uid_stat", NULL);
@@ -147,6 +358,7 @@ static int __init uid_stat_init(void)
 		pr_err("uid_stat: failed to create proc entry\n");
 		return -1;
 	}
+	proc_create("all", S_IRUGO, parent, &all_fops);
 	return 0;
 }
 
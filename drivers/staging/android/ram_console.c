@@ -21,6 +21,7 @@
 #include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
+#include <linux/ram_console.h>
 
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 #include <linux/rslib.h>
@@ -339,6 +340,17 @@ static int ram_console_driver_probe(struct platform_device *pdev)
 		return -ENOMEM;
 	}
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_TRACE
+	/* the trace takes the end of the region, the console the rest */
+	if (buffer_size > 2 * CONFIG_ANDROID_RAM_CONSOLE_TRACE_SIZE) {
+		buffer_size -= CONFIG_ANDROID_RAM_CONSOLE_TRACE_SIZE;
+		ram_trace_init(buffer + buffer_size,
+			       CONFIG_ANDROID_RAM_CONSOLE_TRACE_SIZE);
+	} else {
+		printk(KERN_ERR "ram_console: no room for trace buffer\n");
+	}
+#endif
+
 	return ram_console_init(buffer, buffer_size, NULL/* allocate */);
 }
 
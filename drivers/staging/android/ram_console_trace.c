@@ -0,0 +1,328 @@
+/* drivers/android/ram_console_trace.c
+ *
+ * Persistent trace of scheduler switches, interrupts and long latencies,
+ * kept next to the RAM console so that it survives a watchdog reset.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/ram_console.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <trace/events/irq.h>
+#include <trace/events/sched.h>
+
+/*
+ * The region holds a header with the head of each cpu, followed by a
+ * ring of entries per cpu.  Heads are free running, so after a reset
+ * the ring of a cpu holds its last min(head, entries) entries.
+ */
+struct ram_trace_entry {
+	uint64_t    ts;		/* sched_clock() of the boot that wrote it */
+	uint8_t     type;
+	uint8_t     cpu;
+	uint16_t    a;
+	uint32_t    b;
+};
+
+enum {
+	RAM_TRACE_SWITCH = 1,	/* a = prev state, b = next pid */
+	RAM_TRACE_IRQ_ENTRY,	/* b = irq */
+	RAM_TRACE_IRQ_EXIT,	/* a = handler return, b = irq */
+	RAM_TRACE_LATENCY,	/* a = RAM_TRACE_LAT_*, b = usecs */
+};
+
+struct ram_trace_buffer {
+	uint32_t    sig;
+	uint16_t    nr_cpus;
+	uint16_t    entry_size;
+	uint32_t    entries;	/* per cpu, a power of 2 */
+	uint32_t    head[0];
+};
+
+#define RAM_TRACE_SIG (0x43525444) /* DTRC */
+
+/* irq handlers nested deeper than this are not timed */
+#define RAM_TRACE_IRQ_DEPTH 4
+
+struct ram_trace_irqs {
+	u64 start[RAM_TRACE_IRQ_DEPTH];
+	int depth;
+};
+
+static struct ram_trace_buffer *ram_trace;
+static struct ram_trace_entry *ram_trace_data;
+static u32 ram_trace_mask;
+
+/* heads live in uncached memory, so writers keep their own copy */
+static DEFINE_PER_CPU(u32, ram_trace_head);
+static DEFINE_PER_CPU(struct ram_trace_irqs, ram_trace_irqs);
+
+static unsigned int ram_trace_irq_latency_us = 1000;
+module_param_named(irq_latency_us, ram_trace_irq_latency_us, uint, 0644);
+
+static struct ram_trace_entry *ram_trace_old;
+static size_t ram_trace_old_nr;
+
+/* Called with interrupts disabled */
+static void __ram_trace_write(u8 type, u16 a, u32 b, u64 ts)
+{
+	unsigned int cpu = smp_processor_id();
+	u32 head = per_cpu(ram_trace_head, cpu);
+	struct ram_trace_entry *e;
+
+	e = ram_trace_data + cpu * (ram_trace_mask + 1) +
+	    (head & ram_trace_mask);
+	e->ts = ts;
+	e->type = type;
+	e->cpu = cpu;
+	e->a = a;
+	e->b = b;
+
+	per_cpu(ram_trace_head, cpu) = ++head;
+	ram_trace->head[cpu] = head;
+}
+
+void ram_trace_latency(u16 id, u32 usecs)
+{
+	unsigned long flags;
+
+	if (!ram_trace)
+		return;
+
+	local_irq_save(flags);
+	__ram_trace_write(RAM_TRACE_LATENCY, id, usecs, sched_clock());
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(ram_trace_latency);
+
+static void ram_trace_sched_switch(struct rq *rq, struct task_struct *prev,
+				   struct task_struct *next)
+{
+	/* the tracepoint is called with interrupts disabled */
+	__ram_trace_write(RAM_TRACE_SWITCH, prev->state, next->pid,
+			  sched_clock());
+}
+
+static void ram_trace_irq_entry(int irq, struct irqaction *action)
+{
+	struct ram_trace_irqs *irqs;
+	unsigned long flags;
+	u64 now;
+
+	local_irq_save(flags);
+	now = sched_clock();
+	irqs = &__get_cpu_var(ram_trace_irqs);
+	if (irqs->depth < RAM_TRACE_IRQ_DEPTH)
+		irqs->start[irqs->depth] = now;
+	irqs->depth++;
+	__ram_trace_write(RAM_TRACE_IRQ_ENTRY, 0, irq, now);
+	local_irq_restore(flags);
+}
+
+static void ram_trace_irq_exit(int irq, struct irqaction *action, int ret)
+{
+	struct ram_trace_irqs *irqs;
+	unsigned long flags;
+	u64 now, delta;
+
+	local_irq_save(flags);
+	now = sched_clock();
+	__ram_trace_write(RAM_TRACE_IRQ_EXIT, ret, irq, now);
+	irqs = &__get_cpu_var(ram_trace_irqs);
+	if (irqs->depth && --irqs->depth < RAM_TRACE_IRQ_DEPTH) {
+		delta = now - irqs->start[irqs->depth];
+		if (delta > (u64)ram_trace_irq_latency_us * NSEC_PER_USEC)
+			__ram_trace_write(RAM_TRACE_LATENCY, RAM_TRACE_LAT_IRQ,
+					  div_u64(delta, NSEC_PER_USEC), now);
+	}
+	local_irq_restore(flags);
+}
+
+/* Copy the previous boot's rings out, merged by time, oldest first */
+static void ram_trace_save_old(struct ram_trace_buffer *buffer, u32 entries)
+{
+	struct ram_trace_entry *e, *next;
+	size_t nr = 0;
+	u32 *left;
+	int cpu, next_cpu;
+
+	left = kcalloc(buffer->nr_cpus, sizeof(*left), GFP_KERNEL);
+	if (left == NULL)
+		return;
+	for (cpu = 0; cpu < buffer->nr_cpus; cpu++) {
+		left[cpu] = min(buffer->head[cpu], entries);
+		nr += left[cpu];
+	}
+	if (!nr)
+		goto out;
+
+	ram_trace_old = vmalloc(nr * sizeof(*ram_trace_old));
+	if (ram_trace_old == NULL) {
+		printk(KERN_ERR "ram_console: failed to allocate buffer "
+		       "for old trace\n");
+		goto out;
+	}
+
+	while (ram_trace_old_nr < nr) {
+		next = NULL;
+		next_cpu = 0;
+		for (cpu = 0; cpu < buffer->nr_cpus; cpu++) {
+			if (!left[cpu])
+				continue;
+			e = ram_trace_data + cpu * entries +
+			    ((buffer->head[cpu] - left[cpu]) & (entries - 1));
+			if (next == NULL || e->ts < next->ts) {
+				next = e;
+				next_cpu = cpu;
+			}
+		}
+		ram_trace_old[ram_trace_old_nr++] = *next;
+		left[next_cpu]--;
+	}
+out:
+	kfree(left);
+}
+
+void ram_trace_init(void *buffer, size_t size)
+{
+	struct ram_trace_buffer *buf = buffer;
+	size_t header;
+	u32 entries;
+	int cpu;
+
+	header = ALIGN(sizeof(*buf) + nr_cpu_ids * sizeof(buf->head[0]),
+		       sizeof(struct ram_trace_entry));
+	if (size <= header ||
+	    (size - header) / nr_cpu_ids < sizeof(struct ram_trace_entry)) {
+		pr_err("ram_console: trace buffer %p, invalid size %zu\n",
+		       buffer, size);
+		return;
+	}
+	entries = rounddown_pow_of_two((size - header) / nr_cpu_ids /
+				       sizeof(struct ram_trace_entry));
+	ram_trace_data = buffer + header;
+
+	if (buf->sig == RAM_TRACE_SIG && buf->nr_cpus == nr_cpu_ids &&
+	    buf->entry_size == sizeof(struct ram_trace_entry) &&
+	    buf->entries == entries) {
+		printk(KERN_INFO "ram_console: found existing trace, "
+		       "%d cpus, %d entries\n", buf->nr_cpus, buf->entries);
+		ram_trace_save_old(buf, entries);
+	} else {
+		printk(KERN_INFO "ram_console: no valid trace in buffer "
+		       "(sig = 0x%08x)\n", buf->sig);
+	}
+
+	buf->sig = RAM_TRACE_SIG;
+	buf->nr_cpus = nr_cpu_ids;
+	buf->entry_size = sizeof(struct ram_trace_entry);
+	buf->entries = entries;
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		buf->head[cpu] = 0;
+
+	ram_trace_mask = entries - 1;
+	ram_trace = buf;
+
+	if (register_trace_sched_switch(ram_trace_sched_switch) ||
+	    register_trace_irq_handler_entry(ram_trace_irq_entry) ||
+	    register_trace_irq_handler_exit(ram_trace_irq_exit))
+		printk(KERN_ERR "ram_console: failed to register trace "
+		       "probes\n");
+}
+
+static void *ram_trace_seq_start(struct seq_file *m, loff_t *pos)
+{
+	return *pos < ram_trace_old_nr ? &ram_trace_old[*pos] : NULL;
+}
+
+static void *ram_trace_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return ram_trace_seq_start(m, pos);
+}
+
+static void ram_trace_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int ram_trace_seq_show(struct seq_file *m, void *v)
+{
+	struct ram_trace_entry *e = v;
+	unsigned long long ts = e->ts;
+	unsigned long nsec = do_div(ts, NSEC_PER_SEC);
+
+	seq_printf(m, "[%5llu.%06lu] cpu%u ", ts, nsec / 1000, e->cpu);
+	switch (e->type) {
+	case RAM_TRACE_SWITCH:
+		seq_printf(m, "switch prev_state=%u next_pid=%u\n",
+			   e->a, e->b);
+		break;
+	case RAM_TRACE_IRQ_ENTRY:
+		seq_printf(m, "irq=%u entry\n", e->b);
+		break;
+	case RAM_TRACE_IRQ_EXIT:
+		seq_printf(m, "irq=%u exit ret=%u\n", e->b, e->a);
+		break;
+	case RAM_TRACE_LATENCY:
+		seq_printf(m, "latency id=%u %u us\n", e->a, e->b);
+		break;
+	default:
+		seq_printf(m, "type=%u a=%u b=%u\n", e->type, e->a, e->b);
+		break;
+	}
+	return 0;
+}
+
+static const struct seq_operations ram_trace_seq_ops = {
+	.start = ram_trace_seq_start,
+	.next = ram_trace_seq_next,
+	.stop = ram_trace_seq_stop,
+	.show = ram_trace_seq_show,
+};
+
+static int ram_trace_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &ram_trace_seq_ops);
+}
+
+static const struct file_operations ram_trace_file_ops = {
+	.owner = THIS_MODULE,
+	.open = ram_trace_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+
+static int __init ram_trace_late_init(void)
+{
+	if (ram_trace_old == NULL)
+		return 0;
+
+	if (!proc_create("last_trace", S_IFREG | S_IRUGO, NULL,
+			 &ram_trace_file_ops)) {
+		printk(KERN_ERR "ram_console: failed to create proc entry\n");
+		vfree(ram_trace_old);
+		ram_trace_old = NULL;
+		ram_trace_old_nr = 0;
+	}
+	return 0;
+}
+late_initcall(ram_trace_late_init);
@@ -173,15 +173,12 @@ static void handle_zero_page(struct page *page)
 static void handle_uncompressed_page(struct zram *zram,
 				struct page *page, u32 index)
 {
-	unsigned char *user_mem, *cmem;
+	struct page *pages[2] = { page, zram->table[index].page };
+	void *addrs[2];
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
-
-	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
+	kmap_atomic_pages(pages, addrs, 2, KM_USER0);
+	memcpy(addrs[0], addrs[1] + zram->table[index].offset, PAGE_SIZE);
+	kunmap_atomic_pages(addrs, 2, KM_USER0);
 
 	flush_dcache_page(page);
 }
@@ -205,9 +202,10 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
 		size_t clen;
-		struct page *page;
+		struct page *page, *pages[2];
 		struct zobj_header *zheader;
 		unsigned char *user_mem, *cmem;
+		void *addrs[2];
 
 		page = bvec->bv_page;
 
@@ -233,19 +231,20 @@ static int zram_read(struct zram *zram, struct bio *bio)
 			continue;
 		}
 
-		user_mem = kmap_atomic(page, KM_USER0);
 		clen = PAGE_SIZE;
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		pages[0] = page;
+		pages[1] = zram->table[index].page;
+		kmap_atomic_pages(pages, addrs, 2, KM_USER0);
+		user_mem = addrs[0];
+		cmem = addrs[1] + zram->table[index].offset;
 
 		ret = lzo1x_decompress_safe(
 			cmem + sizeof(*zheader),
 			xv_get_object_size(cmem) - sizeof(*zheader),
 			user_mem, &clen);
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		kunmap_atomic_pages(addrs, 2, KM_USER0);
 
 		/* Should NEVER happen. Return bio error if it does. */
 		if (unlikely(ret != LZO_E_OK)) {
@@ -287,8 +286,9 @@ static int zram_write(struct zram *zram, struct bio *bio)
 		u32 offset;
 		size_t clen;
 		struct zobj_header *zheader;
-		struct page *page, *page_store;
+		struct page *page, *page_store, *pages[2];
 		unsigned char *user_mem, *cmem, *src;
+		void *addrs[2];
 
 		page = bvec->bv_page;
 		src = zram->compress_buffer;
@@ -346,7 +346,6 @@ static int zram_write(struct zram *zram, struct bio *bio)
 			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
 			zram_stat_inc(&zram->stats.pages_expand);
 			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
 			goto memstore;
 		}
 
@@ -363,8 +362,16 @@ static int zram_write(struct zram *zram, struct bio *bio)
 memstore:
 		zram->table[index].offset = offset;
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+			pages[0] = page;
+			pages[1] = zram->table[index].page;
+			kmap_atomic_pages(pages, addrs, 2, KM_USER0);
+			src = addrs[0];
+			cmem = addrs[1];
+		} else {
+			cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
+					zram->table[index].offset;
+		}
 
 #if 0
 		/* Back-reference needed for memory defragmentation */
@@ -377,9 +384,10 @@ memstore:
 
 		memcpy(cmem, src, clen);
 
-		kunmap_atomic(cmem, KM_USER1);
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+			kunmap_atomic_pages(addrs, 2, KM_USER0);
+		else
+			kunmap_atomic(cmem, KM_USER1);
 
 		/* Update stats */
 		zram_stat64_add(zram, &zram->stats.compr_size, clen);
@@ -528,6 +536,10 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
+	/* I/O completes synchronously, so swap on zram skips readahead */
+	zram->disk->queue->backing_dev_info.capabilities |=
+		BDI_CAP_SYNCHRONOUS_IO;
+
 	zram->mem_pool = xv_create_pool();
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
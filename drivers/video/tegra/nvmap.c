@@ -1326,14 +1326,19 @@ static int nvmap_pagealloc(struct nvmap_handle *h, bool contiguous)
 	}
 #endif
 
-	for (i=0; i<cnt; i++) {
-		void *km;
-		SetPageReserved(pages[i]);
-		km = kmap(pages[i]);
-		if (km) __cpuc_flush_dcache_area(km, PAGE_SIZE);
-		outer_flush_range(page_to_phys(pages[i]),
-			page_to_phys(pages[i])+PAGE_SIZE);
-		kunmap(pages[i]);
+	/* map the pages in batches, with one TLB flush per batch */
+	for (i=0; i<cnt; i+=KM_PAGES_NR) {
+		void *km[KM_PAGES_NR];
+		unsigned int j, nr = min_t(unsigned int, cnt-i, KM_PAGES_NR);
+
+		for (j=0; j<nr; j++) SetPageReserved(pages[i+j]);
+		kmap_atomic_pages(&pages[i], km, nr, KM_PAGES);
+		for (j=0; j<nr; j++) {
+			__cpuc_flush_dcache_area(km[j], PAGE_SIZE);
+			outer_flush_range(page_to_phys(pages[i+j]),
+				page_to_phys(pages[i+j])+PAGE_SIZE);
+		}
+		kunmap_atomic_pages(km, nr, KM_PAGES);
 	}
 
 	h->size = cnt<<PAGE_SHIFT;
@@ -329,6 +329,9 @@ void clear_inode(struct inode *inode)
 	invalidate_inode_buffers(inode);
 
 	BUG_ON(inode->i_data.nrpages);
+	/* shadow entries left by filesystems that skip the truncate */
+	if (inode->i_data.nrshadows)
+		truncate_inode_pages(&inode->i_data, 0);
 	BUG_ON(!(inode->i_state & I_FREEING));
 	BUG_ON(inode->i_state & I_CLEAR);
 	inode_sync_wait(inode);
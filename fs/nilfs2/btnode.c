@@ -210,7 +210,7 @@ retry:
 				       (unsigned long long)newkey);
 
 		spin_lock_irq(&btnc->tree_lock);
-		err = radix_tree_insert(&btnc->page_tree, newkey, obh->b_page);
+		err = page_cache_tree_insert(btnc, newkey, obh->b_page, NULL);
 		spin_unlock_irq(&btnc->tree_lock);
 		/*
 		 * Note: page->index will not change to newkey until
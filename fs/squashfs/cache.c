@@ -58,6 +58,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
@@ -91,19 +92,21 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  Evict the one
+			 * that was least recently looked up, so a burst of
+			 * one-off blocks doesn't push out the blocks that are
+			 * being hit repeatedly.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
+			for (i = -1, n = 0; n < cache->entries; n++) {
+				if (cache->entry[n].refcount)
+					continue;
+				if (i == -1 || cache->entry[n].last_used <
+						cache->entry[i].last_used)
+					i = n;
 			}
 
-			cache->next_blk = (i + 1) % cache->entries;
 			entry = &cache->entry[i];
+			entry->last_used = ++cache->clock;
 
 			/*
 			 * Initialise choosen cache entry, and fill it in from
@@ -117,9 +120,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			entry->error = 0;
 			spin_unlock(&cache->lock);
 
-			entry->length = squashfs_read_data(sb, entry->data,
-				block, length, &entry->next_index,
-				cache->block_size, cache->pages);
+			entry->length = squashfs_read_data(sb, block, length,
+				&entry->next_index, entry->actor);
 
 			spin_lock(&cache->lock);
 
@@ -152,6 +154,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		if (entry->refcount == 0)
 			cache->unused--;
 		entry->refcount++;
+		entry->last_used = ++cache->clock;
 
 		/*
 		 * If the entry is currently being filled in by another process
@@ -218,6 +221,7 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 				kfree(cache->entry[i].data[j]);
 			kfree(cache->entry[i].data);
 		}
+		kfree(cache->entry[i].actor);
 	}
 
 	kfree(cache->entry);
@@ -247,7 +251,7 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->next_blk = 0;
+	cache->clock = 0;
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -277,6 +281,13 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 				goto cleanup;
 			}
 		}
+
+		entry->actor = squashfs_page_actor_init(entry->data,
+						cache->pages, 0);
+		if (entry->actor == NULL) {
+			ERROR("Failed to allocate %s cache entry\n", name);
+			goto cleanup;
+		}
 	}
 
 	return cache;
@@ -400,14 +411,22 @@ int squashfs_read_table(struct super_block *sb, void *buffer, u64 block,
 {
 	int pages = (length + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 	int i, res;
+	struct squashfs_page_actor *actor;
 	void **data = kcalloc(pages, sizeof(void *), GFP_KERNEL);
 	if (data == NULL)
 		return -ENOMEM;
 
+	actor = squashfs_page_actor_init(data, pages, length);
+	if (actor == NULL) {
+		kfree(data);
+		return -ENOMEM;
+	}
+
 	for (i = 0; i < pages; i++, buffer += PAGE_CACHE_SIZE)
 		data[i] = buffer;
-	res = squashfs_read_data(sb, data, block, length |
-		SQUASHFS_COMPRESSED_BIT_BLOCK, NULL, length, pages);
+	res = squashfs_read_data(sb, block, length |
+		SQUASHFS_COMPRESSED_BIT_BLOCK, NULL, actor);
 	kfree(data);
+	kfree(actor);
 	return res;
 }
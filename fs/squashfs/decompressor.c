@@ -0,0 +1,237 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008, 2009
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * decompressor.c
+ */
+
+/*
+ * This file maps the compression id stored in the superblock onto the
+ * decompressor implementing it, and reads any compressor specific options
+ * stored after the superblock.
+ */
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/buffer_head.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "decompressor.h"
+#include "squashfs.h"
+#include "page_actor.h"
+
+/*
+ * This file (and decompressor.h) implements a decompressor framework for
+ * Squashfs, allowing multiple decompressors to be easily supported
+ */
+
+static const struct squashfs_decompressor squashfs_lzma_unsupported_comp_ops = {
+	NULL, NULL, NULL, LZMA_COMPRESSION, "lzma", 0
+};
+
+#ifndef CONFIG_SQUASHFS_LZO
+static const struct squashfs_decompressor squashfs_lzo_comp_ops = {
+	NULL, NULL, NULL, LZO_COMPRESSION, "lzo", 0
+};
+#endif
+
+#ifndef CONFIG_SQUASHFS_XZ
+static const struct squashfs_decompressor squashfs_xz_comp_ops = {
+	NULL, NULL, NULL, XZ_COMPRESSION, "xz", 0
+};
+#endif
+
+static const struct squashfs_decompressor squashfs_unknown_comp_ops = {
+	NULL, NULL, NULL, 0, "unknown", 0
+};
+
+static const struct squashfs_decompressor *decompressor[] = {
+	&squashfs_zlib_comp_ops,
+	&squashfs_lzma_unsupported_comp_ops,
+	&squashfs_lzo_comp_ops,
+	&squashfs_xz_comp_ops,
+	&squashfs_unknown_comp_ops
+};
+
+
+const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
+{
+	int i;
+
+	for (i = 0; decompressor[i]->id; i++)
+		if (id == decompressor[i]->id)
+			break;
+
+	return decompressor[i];
+}
+
+
+/*
+ * Allocate the decompressor state for msblk->decompressor, as many streams
+ * as the decompressor_xxx.c implementation wants.  Returns an ERR_PTR on
+ * failure.
+ */
+void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct squashfs_page_actor *actor = NULL;
+	void *strm, *buffer = NULL;
+	int length = 0;
+
+	/*
+	 * Read decompressor specific options from file system if present.
+	 * They are always stored uncompressed, so no decompressor state is
+	 * needed to read them.
+	 */
+	if (SQUASHFS_COMP_OPTS(flags)) {
+		buffer = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
+		if (buffer == NULL)
+			return ERR_PTR(-ENOMEM);
+
+		actor = squashfs_page_actor_init(&buffer, 1, 0);
+		if (actor == NULL) {
+			strm = ERR_PTR(-ENOMEM);
+			goto finished;
+		}
+
+		length = squashfs_read_data(sb,
+			sizeof(struct squashfs_super_block), 0, NULL, actor);
+
+		if (length < 0) {
+			strm = ERR_PTR(length);
+			goto finished;
+		}
+	}
+
+	strm = squashfs_decompressor_create(msblk, buffer, length);
+
+finished:
+	kfree(actor);
+	kfree(buffer);
+
+	return strm;
+}
+
+
+/*
+ * Decompression statistics, summed over all mounted filesystems.  Kept per
+ * cpu so that accounting never bounces a cacheline between readers
+ * decompressing in parallel.
+ */
+struct squashfs_decompress_stats {
+	unsigned long	blocks;
+	unsigned long	errors;
+	u64		bytes_in;
+	u64		bytes_out;
+	u64		time_ns;
+};
+
+static DEFINE_PER_CPU(struct squashfs_decompress_stats, decompress_stats);
+
+void squashfs_decompress_account(int bytes_in, int bytes_out, s64 ns)
+{
+	struct squashfs_decompress_stats *stats;
+
+	stats = &get_cpu_var(decompress_stats);
+	if (bytes_out < 0)
+		stats->errors++;
+	else {
+		stats->blocks++;
+		stats->bytes_in += bytes_in;
+		stats->bytes_out += bytes_out;
+	}
+	stats->time_ns += ns;
+	put_cpu_var(decompress_stats);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *squashfs_debugfs_dir;
+
+static int decompress_stats_show(struct seq_file *m, void *unused)
+{
+	struct squashfs_decompress_stats sum;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct squashfs_decompress_stats *stats =
+			&per_cpu(decompress_stats, cpu);
+
+		sum.blocks += stats->blocks;
+		sum.errors += stats->errors;
+		sum.bytes_in += stats->bytes_in;
+		sum.bytes_out += stats->bytes_out;
+		sum.time_ns += stats->time_ns;
+	}
+
+	seq_printf(m, "decompressors: %d\n", squashfs_max_decompressors());
+	seq_printf(m, "blocks: %lu\n", sum.blocks);
+	seq_printf(m, "errors: %lu\n", sum.errors);
+	seq_printf(m, "bytes_in: %llu\n", sum.bytes_in);
+	seq_printf(m, "bytes_out: %llu\n", sum.bytes_out);
+	seq_printf(m, "time_ns: %llu\n", sum.time_ns);
+	return 0;
+}
+
+static int decompress_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, decompress_stats_show, NULL);
+}
+
+static const struct file_operations decompress_stats_fops = {
+	.open		= decompress_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+int __init squashfs_stats_init(void)
+{
+	squashfs_debugfs_dir = debugfs_create_dir("squashfs", NULL);
+	if (IS_ERR_OR_NULL(squashfs_debugfs_dir)) {
+		squashfs_debugfs_dir = NULL;
+		return 0;
+	}
+
+	debugfs_create_file("decompress_stats", S_IRUGO, squashfs_debugfs_dir,
+		NULL, &decompress_stats_fops);
+	return 0;
+}
+
+void squashfs_stats_exit(void)
+{
+	debugfs_remove_recursive(squashfs_debugfs_dir);
+}
+#else
+int __init squashfs_stats_init(void)
+{
+	return 0;
+}
+
+void squashfs_stats_exit(void)
+{
+}
+#endif
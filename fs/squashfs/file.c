@@ -48,11 +48,14 @@
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
 #include <linux/zlib.h>
+#include <linux/workqueue.h>
+#include <linux/cpu.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -372,26 +375,54 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
-static int squashfs_readpage(struct file *file, struct page *page)
+/*
+ * Decompress a datablock straight into the page cache pages covering it,
+ * avoiding the datablock cache and the copy out of it.
+ */
+static int squashfs_read_direct(struct super_block *sb, u64 block, int bsize,
+	struct page **page, int pages)
+{
+	struct squashfs_page_actor *actor;
+	int res;
+
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		return -ENOMEM;
+
+	res = squashfs_read_data(sb, block, bsize, NULL, actor);
+	kfree(actor);
+
+	return res;
+}
+
+
+/*
+ * Fill page cache pages from datablock 'index' of 'inode' (or the fragment
+ * holding the file's tail end).  page[i], if not NULL, is the locked page
+ * at page index 'first' + i; all nr of them lie inside the block.
+ *
+ * If the slots cover every page of a (non-fragment, non-sparse) datablock
+ * that lies inside the file, the block is decompressed directly into them.
+ * Otherwise it is read through the datablock or fragment cache and copied
+ * out.  Either way each page is marked uptodate (or in error), unlocked and
+ * released.  Nothing belonging to the filesystem is touched once the pages
+ * are unlocked, as that may be all that is keeping an unmount waiting.
+ */
+static void squashfs_fill_block(struct inode *inode, int index,
+	struct page **page, int first, int nr)
 {
-	struct inode *inode = page->mapping->host;
 	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
-	int bytes, i, offset = 0, sparse = 0;
 	struct squashfs_cache_entry *buffer = NULL;
-	void *pageaddr;
-
-	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
-	int index = page->index >> (msblk->block_log - PAGE_CACHE_SHIFT);
-	int start_index = page->index & ~mask;
-	int end_index = start_index | mask;
 	int file_end = i_size_read(inode) >> msblk->block_log;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int start_index = index << shift;
+	int bytes = 0, i, offset = 0, sparse = 0, error = 0, direct = 0;
+	void *pageaddr;
 
-	TRACE("Entered squashfs_readpage, page index %lx, start block %llx\n",
-				page->index, squashfs_i(inode)->start);
-
-	if (page->index >= ((i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
-					PAGE_CACHE_SHIFT))
-		goto out;
+	for (i = 0; i < nr && page[i] == NULL; i++)
+		;
+	if (i >= nr)
+		return;
 
 	if (index < file_end || squashfs_i(inode)->fragment_block ==
 					SQUASHFS_INVALID_BLK) {
@@ -401,28 +432,52 @@ static int squashfs_readpage(struct file *file, struct page *page)
 		 */
 		u64 block = 0;
 		int bsize = read_blocklist(inode, index, &block);
-		if (bsize < 0)
-			goto error_out;
+		int file_pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+
+		if (bsize < 0) {
+			error = 1;
+			goto fill;
+		}
 
 		if (bsize == 0) { /* hole */
 			bytes = index == file_end ?
 				(i_size_read(inode) & (msblk->block_size - 1)) :
 				 msblk->block_size;
 			sparse = 1;
-		} else {
-			/*
-			 * Read and decompress datablock.
-			 */
-			buffer = squashfs_get_datablock(inode->i_sb,
-								block, bsize);
-			if (buffer->error) {
-				ERROR("Unable to read page, block %llx, size %x"
-					"\n", block, bsize);
-				squashfs_cache_put(buffer);
-				goto error_out;
+			goto fill;
+		}
+
+		if (first == start_index && nr == min(1 << shift,
+						file_pages - start_index)) {
+			for (i = 0; i < nr && page[i]; i++)
+				;
+			if (i == nr) {
+				bytes = squashfs_read_direct(inode->i_sb,
+						block, bsize, page, nr);
+				if (bytes != -ENOMEM) {
+					error = bytes < 0;
+					direct = 1;
+					goto fill;
+				}
 			}
-			bytes = buffer->length;
 		}
+
+		/*
+		 * Some of the block's pages are missing (reclaimed, already
+		 * uptodate, or held by another reader), read and decompress
+		 * the datablock into the cache and copy from there.
+		 */
+		buffer = squashfs_get_datablock(inode->i_sb, block, bsize);
+		if (buffer->error) {
+			ERROR("Unable to read page, block %llx, size %x\n",
+				block, bsize);
+			squashfs_cache_put(buffer);
+			buffer = NULL;
+			error = 1;
+			goto fill;
+		}
+		bytes = buffer->length;
 	} else {
 		/*
 		 * Datablock is stored inside a fragment (tail-end packed
@@ -437,66 +492,265 @@ static int squashfs_readpage(struct file *file, struct page *page)
 				squashfs_i(inode)->fragment_block,
 				squashfs_i(inode)->fragment_size);
 			squashfs_cache_put(buffer);
-			goto error_out;
+			buffer = NULL;
+			error = 1;
+			goto fill;
 		}
 		bytes = i_size_read(inode) & (msblk->block_size - 1);
 		offset = squashfs_i(inode)->fragment_offset;
 	}
 
-	/*
-	 * Loop copying datablock into pages.  As the datablock likely covers
-	 * many PAGE_CACHE_SIZE pages (default block size is 128 KiB) explicitly
-	 * grab the pages from the page cache, except for the page that we've
-	 * been called to fill.
-	 */
-	for (i = start_index; i <= end_index && bytes > 0; i++,
-			bytes -= PAGE_CACHE_SIZE, offset += PAGE_CACHE_SIZE) {
-		struct page *push_page;
-		int avail = sparse ? 0 : min_t(int, bytes, PAGE_CACHE_SIZE);
+fill:
+	for (i = 0; i < nr; i++) {
+		int pg_offset = (first + i - start_index) << PAGE_CACHE_SHIFT;
+		int avail = sparse || error ? 0 :
+			clamp_t(int, bytes - pg_offset, 0, PAGE_CACHE_SIZE);
 
-		TRACE("bytes %d, i %d, available_bytes %d\n", bytes, i, avail);
+		if (page[i] == NULL)
+			continue;
 
-		push_page = (i == page->index) ? page :
-			grab_cache_page_nowait(page->mapping, i);
+		TRACE("bytes %d, page %lx, available_bytes %d\n", bytes,
+			page[i]->index, avail);
 
-		if (!push_page)
+		/* Decompressed in place, only a short last page needs work */
+		if (direct && avail == PAGE_CACHE_SIZE) {
+			flush_dcache_page(page[i]);
 			continue;
+		}
 
-		if (PageUptodate(push_page))
-			goto skip_page;
-
-		pageaddr = kmap_atomic(push_page, KM_USER0);
-		squashfs_copy_data(pageaddr, buffer, offset, avail);
+		pageaddr = kmap_atomic(page[i], KM_USER0);
+		if (!direct)
+			squashfs_copy_data(pageaddr, buffer, offset + pg_offset,
+								avail);
 		memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
 		kunmap_atomic(pageaddr, KM_USER0);
-		flush_dcache_page(push_page);
-		SetPageUptodate(push_page);
-skip_page:
-		unlock_page(push_page);
-		if (i != page->index)
-			page_cache_release(push_page);
+		flush_dcache_page(page[i]);
 	}
 
-	if (!sparse)
+	if (buffer)
 		squashfs_cache_put(buffer);
 
+	for (i = 0; i < nr; i++) {
+		if (page[i] == NULL)
+			continue;
+		if (error)
+			SetPageError(page[i]);
+		else
+			SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+}
+
+
+/*
+ * Grab the page cache pages for the empty slots in 'page' (slot i being
+ * page index 'first' + i), so the whole block can be decompressed in place.
+ * Pages that are already uptodate are left alone.
+ */
+static void squashfs_grab_pages(struct address_space *mapping,
+	struct page **page, int first, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (page[i])
+			continue;
+
+		page[i] = grab_cache_page_nowait(mapping, first + i);
+		if (page[i] && PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = NULL;
+		}
+	}
+}
+
+
+static int squashfs_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	struct page **push_page;
+	void *pageaddr;
+
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int index = page->index >> shift;
+	int start_index = index << shift;
+	int file_pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+	int pages = min(1 << shift, file_pages - start_index);
+
+	TRACE("Entered squashfs_readpage, page index %lx, start block %llx\n",
+				page->index, squashfs_i(inode)->start);
+
+	if (page->index >= file_pages)
+		goto out;
+
+	/* squashfs_fill_block() releases the pages it is given */
+	page_cache_get(page);
+
+	/*
+	 * As the datablock likely covers many PAGE_CACHE_SIZE pages (default
+	 * block size is 128 KiB) explicitly grab the pages from the page
+	 * cache, except for the page that we've been called to fill.
+	 */
+	push_page = kcalloc(pages, sizeof(*push_page), GFP_KERNEL);
+	if (push_page == NULL) {
+		squashfs_fill_block(inode, index, &page, page->index, 1);
+		return 0;
+	}
+
+	push_page[page->index - start_index] = page;
+	squashfs_grab_pages(page->mapping, push_page, start_index, pages);
+	squashfs_fill_block(inode, index, push_page, start_index, pages);
+	kfree(push_page);
+
 	return 0;
 
-error_out:
-	SetPageError(page);
 out:
 	pageaddr = kmap_atomic(page, KM_USER0);
 	memset(pageaddr, 0, PAGE_CACHE_SIZE);
 	kunmap_atomic(pageaddr, KM_USER0);
 	flush_dcache_page(page);
-	if (!PageError(page))
-		SetPageUptodate(page);
+	SetPageUptodate(page);
 	unlock_page(page);
 
 	return 0;
 }
 
 
+/*
+ * Readahead.  The pages are added to the page cache and grouped by the
+ * datablock they belong to, and each group is completed with any other
+ * pages of its block so it can be decompressed in place.  With more than
+ * one decompressor, groups are dealt out to squashfs_read_wq on the other
+ * online cpus so a readahead window spanning several datablocks is
+ * decompressed in parallel while this task decompresses its own share.
+ */
+struct squashfs_readahead {
+	struct work_struct	work;
+	struct list_head	list;
+	struct inode		*inode;
+	int			index;
+	int			first;
+	int			pages;
+	struct page		*page[0];
+};
+
+static struct workqueue_struct *squashfs_read_wq;
+
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead *ra = container_of(work,
+				struct squashfs_readahead, work);
+
+	squashfs_fill_block(ra->inode, ra->index, ra->page, ra->first,
+		ra->pages);
+	kfree(ra);
+}
+
+
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+	struct squashfs_readahead *ra = NULL, *next;
+	int self, cpu, n = 0, parallel;
+	LIST_HEAD(batches);
+
+	TRACE("Entered squashfs_readpages, %u pages, start block %llx\n",
+				nr_pages, squashfs_i(inode)->start);
+
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+		int index = page->index >> shift;
+
+		if (ra == NULL || ra->index != index) {
+			ra = kzalloc(sizeof(*ra) + (sizeof(struct page *) <<
+						shift), GFP_KERNEL);
+			if (ra == NULL)
+				break;	/* read_pages() frees the rest */
+
+			INIT_WORK(&ra->work, squashfs_readahead_work);
+			ra->inode = inode;
+			ra->index = index;
+			ra->first = index << shift;
+			ra->pages = min(1 << shift, file_pages - ra->first);
+			list_add_tail(&ra->list, &batches);
+		}
+
+		list_del(&page->lru);
+		if (page->index < file_pages && !add_to_page_cache_lru(page,
+					mapping, page->index, GFP_KERNEL))
+			ra->page[page->index - ra->first] = page;
+		else
+			page_cache_release(page);
+	}
+
+	list_for_each_entry(ra, &batches, list)
+		squashfs_grab_pages(mapping, ra->page, ra->first, ra->pages);
+
+	/*
+	 * Hand every parallel'th batch to another cpu first, then work
+	 * through the rest here.  get_online_cpus() keeps the chosen cpus
+	 * from going away before the work is queued; work already queued
+	 * on a cpu that goes offline is flushed by the workqueue code.
+	 */
+	if (squashfs_read_wq) {
+		get_online_cpus();
+		parallel = min_t(int, squashfs_max_decompressors(),
+							num_online_cpus());
+		self = cpu = raw_smp_processor_id();
+		list_for_each_entry_safe(ra, next, &batches, list) {
+			if (n++ % parallel == 0)
+				continue;
+
+			do {
+				cpu = cpumask_next(cpu, cpu_online_mask);
+				if (cpu >= nr_cpu_ids)
+					cpu = cpumask_first(cpu_online_mask);
+			} while (cpu == self);
+
+			list_del(&ra->list);
+			queue_work_on(cpu, squashfs_read_wq, &ra->work);
+		}
+		put_online_cpus();
+	}
+
+	list_for_each_entry_safe(ra, next, &batches, list) {
+		squashfs_fill_block(inode, ra->index, ra->page, ra->first,
+			ra->pages);
+		kfree(ra);
+	}
+
+	return 0;
+}
+
+
+int __init squashfs_readahead_init(void)
+{
+	if (squashfs_max_decompressors() == 1)
+		return 0;
+
+	squashfs_read_wq = create_workqueue("squashfs_read");
+	return squashfs_read_wq ? 0 : -ENOMEM;
+}
+
+
+void squashfs_readahead_exit(void)
+{
+	if (squashfs_read_wq)
+		destroy_workqueue(squashfs_read_wq);
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
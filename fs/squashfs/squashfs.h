@@ -33,8 +33,24 @@ static inline struct squashfs_inode_info *squashfs_i(struct inode *inode)
 }
 
 /* block.c */
-extern int squashfs_read_data(struct super_block *, void **, u64, int, u64 *,
-				int, int);
+extern int squashfs_read_data(struct super_block *, u64, int, u64 *,
+				struct squashfs_page_actor *);
+
+/* decompressor.c */
+extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
+extern void *squashfs_decompressor_init(struct super_block *, unsigned short);
+extern void squashfs_decompress_account(int, int, s64);
+extern int squashfs_stats_init(void);
+extern void squashfs_stats_exit(void);
+
+/* decompressor_xxx.c */
+extern void *squashfs_decompressor_create(struct squashfs_sb_info *, void *,
+				int);
+extern void squashfs_decompressor_destroy(struct squashfs_sb_info *);
+extern int squashfs_decompress(struct squashfs_sb_info *,
+				struct buffer_head **, int, int, int,
+				struct squashfs_page_actor *);
+extern int squashfs_max_decompressors(void);
 
 /* cache.c */
 extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
@@ -82,6 +98,8 @@ extern const struct export_operations squashfs_export_ops;
 
 /* file.c */
 extern const struct address_space_operations squashfs_aops;
+extern int squashfs_readahead_init(void);
+extern void squashfs_readahead_exit(void);
 
 /* namei.c */
 extern const struct inode_operations squashfs_dir_inode_ops;
@@ -28,7 +28,7 @@
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			next_blk;
+	unsigned long		clock;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
@@ -42,6 +42,7 @@ struct squashfs_cache_entry {
 	u64			block;
 	int			length;
 	int			refcount;
+	unsigned long		last_used;
 	u64			next_index;
 	int			pending;
 	int			error;
@@ -49,6 +50,7 @@ struct squashfs_cache_entry {
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache	*cache;
 	void			**data;
+	struct squashfs_page_actor *actor;
 };
 
 struct squashfs_sb_info {
@@ -57,14 +59,14 @@ struct squashfs_sb_info {
 	struct squashfs_cache	*block_cache;
 	struct squashfs_cache	*fragment_cache;
 	struct squashfs_cache	*read_page;
+	const struct squashfs_decompressor *decompressor;
 	int			next_meta_index;
 	__le64			*id_table;
 	__le64			*fragment_index;
 	unsigned int		*fragment_index_2;
-	struct mutex		read_data_mutex;
 	struct mutex		meta_index_mutex;
 	struct meta_index	*meta_index;
-	z_stream		stream;
+	void			*stream;
 	__le64			*inode_lookup_table;
 	u64			inode_table;
 	u64			directory_table;
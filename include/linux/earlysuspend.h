@@ -29,6 +29,8 @@
  * the suspend handlers have already been called without a matching call to the
  * resume handlers, the suspend handler will be called directly from
  * register_early_suspend. This direct call can violate the normal level order.
+ * Handlers registered at the same level are called concurrently, so a handler
+ * that depends on another must use a higher level (for suspend) than it.
  */
 enum {
 	EARLY_SUSPEND_LEVEL_BLANK_SCREEN = 50,
@@ -41,6 +43,12 @@ struct early_suspend {
 	int level;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
+	/* private: maintained by the early suspend core */
+	int pending;
+	unsigned int suspend_us;
+	unsigned int max_suspend_us;
+	unsigned int resume_us;
+	unsigned int max_resume_us;
 #endif
 };
 
@@ -75,6 +75,29 @@ static inline void *kmap_atomic(struct page *page, enum km_type idx)
 
 #endif /* CONFIG_HIGHMEM */
 
+/*
+ * Map nr pages at once, page i in slot type + i, and unmap them again.
+ * Architectures that can batch the TLB maintenance of the slots provide
+ * their own.
+ */
+#ifndef ARCH_HAS_KMAP_ATOMIC_PAGES
+static inline void kmap_atomic_pages(struct page **pages, void **addrs,
+				     int nr, enum km_type type)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		addrs[i] = kmap_atomic(pages[i], type + i);
+}
+
+static inline void kunmap_atomic_pages(void **addrs, int nr,
+				       enum km_type type)
+{
+	while (nr--)
+		kunmap_atomic(addrs[nr], type + nr);
+}
+#endif
+
 /* when CONFIG_HIGHMEM is not set these will be plain clear/copy_page */
 #ifndef clear_user_highpage
 static inline void clear_user_highpage(struct page *page, unsigned long vaddr)
@@ -0,0 +1,28 @@
+#ifndef _LINUX_MICROBENCH_H
+#define _LINUX_MICROBENCH_H
+
+#include <linux/types.h>
+
+/*
+ * Microbenchmarks in debugfs, see CONFIG_DEBUG_MICROBENCH.  Reading
+ * /sys/kernel/debug/bench/<name> calls ->run, which times its fast path
+ * and formats the results into buf with microbench_print().
+ */
+struct microbench {
+	const char	*name;
+	/* returns the length of the text in buf, or a negative errno */
+	int		(*run)(char *buf, size_t size);
+};
+
+#ifdef CONFIG_DEBUG_MICROBENCH
+int microbench_register(struct microbench *mb);
+int microbench_print(char *buf, size_t size, const char *label, u64 ns,
+		     unsigned long loops, const char *unit);
+#else
+static inline int microbench_register(struct microbench *mb)
+{
+	return 0;
+}
+#endif
+
+#endif /* _LINUX_MICROBENCH_H */
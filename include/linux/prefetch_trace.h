@@ -0,0 +1,58 @@
+#ifndef _LINUX_PREFETCH_TRACE_H
+#define _LINUX_PREFETCH_TRACE_H
+
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+/*
+ * Layout of a trace as read from /sys/kernel/mm/prefetch/trace and
+ * written back to /sys/kernel/mm/prefetch/replay, see
+ * Documentation/vm/prefetch-trace.txt.  All fields are native endian.
+ *
+ * The header is followed by nr_files file entries, each padded to 4
+ * bytes, and then by nr_ranges ranges.
+ */
+#define PREFETCH_TRACE_MAGIC	0x52544650	/* PFTR */
+
+struct prefetch_trace_header {
+	__u32	magic;
+	__u32	size;		/* of the whole trace, header included */
+	__u32	nr_files;
+	__u32	nr_ranges;
+};
+
+struct prefetch_trace_file {
+	__u16	len;		/* of path, terminating NUL included */
+	char	path[0];
+};
+
+struct prefetch_trace_range {
+	__u32	file;		/* index of the file entry */
+	__u32	start;		/* first page */
+	__u32	nr_pages;
+};
+
+#ifdef __KERNEL__
+struct file;
+
+#ifdef CONFIG_PREFETCH_TRACE
+extern int prefetch_recording;
+void __prefetch_trace_record(struct file *file, pgoff_t start,
+			     unsigned long nr_pages);
+
+/* Pages start..start+nr_pages-1 of file are about to be read from disk */
+static inline void prefetch_trace_record(struct file *file, pgoff_t start,
+					 unsigned long nr_pages)
+{
+	if (unlikely(prefetch_recording))
+		__prefetch_trace_record(file, start, nr_pages);
+}
+#else
+static inline void prefetch_trace_record(struct file *file, pgoff_t start,
+					 unsigned long nr_pages)
+{
+}
+#endif
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_PREFETCH_TRACE_H */
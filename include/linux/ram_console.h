@@ -0,0 +1,40 @@
+/* include/linux/ram_console.h
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_RAM_CONSOLE_H
+#define _LINUX_RAM_CONSOLE_H
+
+#include <linux/types.h>
+
+void ram_console_enable_console(int enabled);
+
+/* ids of RAM_TRACE_LATENCY entries, drivers may add their own */
+enum {
+	RAM_TRACE_LAT_IRQ,		/* irq handler, follows its exit */
+	RAM_TRACE_LAT_USER = 0x100,	/* first id for drivers */
+};
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_TRACE
+void ram_trace_init(void *buffer, size_t size);
+void ram_trace_latency(u16 id, u32 usecs);
+#else
+static inline void ram_trace_init(void *buffer, size_t size)
+{
+}
+
+static inline void ram_trace_latency(u16 id, u32 usecs)
+{
+}
+#endif
+
+#endif /* _LINUX_RAM_CONSOLE_H */
@@ -74,6 +74,22 @@ ring_buffer_event_time_delta(struct ring_buffer_event *event)
 	return event->time_delta;
 }
 
+/*
+ * Compact events, written with ring_buffer_write_compact(), hold a 16 bit
+ * id followed by at most RB_COMPACT_MAX_DATA bytes of payload.
+ */
+#define RB_COMPACT_MAX_DATA	(RINGBUF_TYPE_DATA_TYPE_LEN_MAX * 4 - sizeof(u16))
+
+static inline u16 ring_buffer_compact_id(struct ring_buffer_event *event)
+{
+	return *(u16 *)ring_buffer_event_data(event);
+}
+
+static inline void *ring_buffer_compact_data(struct ring_buffer_event *event)
+{
+	return (u16 *)ring_buffer_event_data(event) + 1;
+}
+
 /*
  * ring_buffer_discard_commit will remove an event that has not
  *   ben committed yet. If this is used, then ring_buffer_unlock_commit
@@ -118,6 +134,8 @@ int ring_buffer_unlock_commit(struct ring_buffer *buffer,
 			      struct ring_buffer_event *event);
 int ring_buffer_write(struct ring_buffer *buffer,
 		      unsigned long length, void *data);
+int ring_buffer_write_compact(struct ring_buffer *buffer, u16 id,
+			      const void *data, unsigned long length);
 
 struct ring_buffer_event *
 ring_buffer_peek(struct ring_buffer *buffer, int cpu, u64 *ts);
@@ -1750,6 +1750,7 @@ extern int task_free_unregister(struct notifier_block *n);
 #define PF_EXITING	0x00000004	/* getting shut down */
 #define PF_EXITPIDONE	0x00000008	/* pi exit done on shut down */
 #define PF_VCPU		0x00000010	/* I'm a virtual CPU */
+#define PF_WQ_WORKER	0x00000020	/* I'm a workqueue pool worker */
 #define PF_FORKNOEXEC	0x00000040	/* forked but didn't exec */
 #define PF_MCE_PROCESS  0x00000080      /* process policy on mce errors */
 #define PF_SUPERPRIV	0x00000100	/* used super-user privileges */
@@ -1965,9 +1966,20 @@ extern unsigned int sysctl_sched_compat_yield;
 
 #ifdef CONFIG_SCHED_AUTOGROUP
 extern unsigned int sysctl_sched_autogroup_enabled;
+extern unsigned int sysctl_sched_autogroup_mode;
+extern unsigned int sysctl_sched_autogroup_fg_shares;
+extern unsigned int sysctl_sched_autogroup_bg_shares;
+extern int sysctl_sched_autogroup_fg_oom_adj;
+
+int sched_autogroup_shares_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *lenp,
+		loff_t *ppos);
 
 extern void sched_autogroup_create_attach(struct task_struct *p);
 extern void sched_autogroup_detach(struct task_struct *p);
+extern void sched_autogroup_setsid(struct task_struct *p);
+extern void sched_autogroup_setuid(struct task_struct *p);
+extern void sched_autogroup_oom_adj(struct task_struct *p, int oom_adj);
 extern void sched_autogroup_fork(struct signal_struct *sig);
 extern void sched_autogroup_exit(struct signal_struct *sig);
 #ifdef CONFIG_PROC_FS
@@ -1977,6 +1989,9 @@ extern int proc_sched_autogroup_set_nice(struct task_struct *p, int *nice);
 #else
 static inline void sched_autogroup_create_attach(struct task_struct *p) { }
 static inline void sched_autogroup_detach(struct task_struct *p) { }
+static inline void sched_autogroup_setsid(struct task_struct *p) { }
+static inline void sched_autogroup_setuid(struct task_struct *p) { }
+static inline void sched_autogroup_oom_adj(struct task_struct *p, int oom_adj) { }
 static inline void sched_autogroup_fork(struct signal_struct *sig) { }
 static inline void sched_autogroup_exit(struct signal_struct *sig) { }
 #endif
@@ -178,6 +178,17 @@ struct swap_info_struct {
 	unsigned int max;
 	unsigned int inuse_pages;
 	unsigned int old_block_size;
+	int ra_policy;			/* SWAP_RA_* */
+	unsigned int ra_window;		/* pages in the last readahead */
+	unsigned long ra_prev_offset;	/* offset of the last readahead */
+	atomic_t ra_hits;		/* readahead pages used since */
+};
+
+/* Swap readahead policies, see valid_swaphandles() */
+enum {
+	SWAP_RA_FIXED,		/* read 1 << page_cluster slots */
+	SWAP_RA_NONE,		/* read only the faulting slot */
+	SWAP_RA_ADAPTIVE,	/* size the window on readahead hits */
 };
 
 struct swap_list_t {
@@ -188,6 +199,13 @@ struct swap_list_t {
 /* Swap 50% full? Release swapcache more aggressively.. */
 #define vm_swap_full() (nr_swap_pages*2 < total_swap_pages)
 
+/* linux/mm/workingset.c */
+void *workingset_eviction(struct address_space *mapping, struct page *page);
+bool workingset_refault(void *shadow);
+void workingset_activation(struct page *page);
+void workingset_shadow_added(struct address_space *mapping);
+void workingset_shadow_removed(struct address_space *mapping);
+
 /* linux/mm/page_alloc.c */
 extern unsigned long totalram_pages;
 extern unsigned long totalreserve_pages;
@@ -224,6 +242,11 @@ static inline void lru_cache_add_file(struct page *page)
 	__lru_cache_add(page, LRU_INACTIVE_FILE);
 }
 
+/* LRU Isolation modes. */
+#define ISOLATE_INACTIVE 0	/* Isolate inactive pages. */
+#define ISOLATE_ACTIVE 1	/* Isolate active pages. */
+#define ISOLATE_BOTH 2		/* Isolate both active and inactive pages. */
+
 /* linux/mm/vmscan.c */
 extern unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 					gfp_t gfp_mask, nodemask_t *mask);
@@ -38,5 +38,19 @@ static inline void taskstats_init_early(void)
 {}
 #endif /* CONFIG_TASKSTATS */
 
+#ifdef CONFIG_TASKSTATS_RING
+struct sk_buff;
+struct netlink_callback;
+struct genl_family;
+
+extern void taskstats_ring_switch(struct task_struct *prev, u64 now);
+extern int taskstats_ring_dump(struct sk_buff *skb,
+			       struct netlink_callback *cb,
+			       struct genl_family *family);
+#else
+static inline void taskstats_ring_switch(struct task_struct *prev, u64 now)
+{}
+#endif /* CONFIG_TASKSTATS_RING */
+
 #endif
 
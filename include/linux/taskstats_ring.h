@@ -0,0 +1,77 @@
+/* taskstats_ring.h - per-task scheduling accounting ring
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef _LINUX_TASKSTATS_RING_H
+#define _LINUX_TASKSTATS_RING_H
+
+#include <linux/types.h>
+#include <linux/cgroupstats.h>
+
+/*
+ * One entry is logged each time a task is switched out.  The counters
+ * are the task's running totals, truncated to their width, so the
+ * activity between two switches of a task is the difference between
+ * two of its entries, modulo the width of the field.
+ *
+ * Times are in units of 1024 nanoseconds.
+ */
+struct taskstats_ring_entry {
+	__u64	timestamp;	/* ns, runqueue clock of the switch */
+	__u32	pid;
+	__u32	tgid;
+	__u32	run_time;	/* time on the cpu */
+	__u32	run_delay;	/* time waiting on a runqueue */
+	__u32	io_delay;	/* time waiting for block I/O and swapin */
+	__u16	nvcsw;		/* voluntary switches, i.e. wakeups */
+	__u16	nivcsw;		/* involuntary switches */
+	__u16	migrations;	/* cpu migrations */
+	__u16	min_flt;	/* minor page faults */
+	__u16	maj_flt;	/* major page faults */
+	__u8	cpu;
+	__u8	state;		/* TASKSTATS_RING_STATE_* */
+};
+
+#define TASKSTATS_RING_STATE_PREEMPTED	0	/* still runnable */
+#define TASKSTATS_RING_STATE_SLEEPING	1	/* interruptible sleep */
+#define TASKSTATS_RING_STATE_BLOCKED	2	/* uninterruptible sleep */
+#define TASKSTATS_RING_STATE_IOWAIT	3	/* waiting for I/O */
+#define TASKSTATS_RING_STATE_OTHER	4	/* stopped, exiting, ... */
+
+/*
+ * Commands sent from userspace
+ * Not versioned. New commands should only be inserted at the enum's end
+ * prior to __TASKSTATS_RING_CMD_MAX
+ */
+
+enum {
+	TASKSTATS_RING_CMD_UNSPEC = __CGROUPSTATS_CMD_MAX,	/* Reserved */
+	TASKSTATS_RING_CMD_GET,		/* user->kernel dump request */
+	TASKSTATS_RING_CMD_NEW,		/* kernel->user batch of entries */
+	__TASKSTATS_RING_CMD_MAX,
+};
+
+#define TASKSTATS_RING_CMD_MAX (__TASKSTATS_RING_CMD_MAX - 1)
+
+/*
+ * A TASKSTATS_RING_CMD_GET dump drains the rings of all cpus.  Every
+ * message of the reply holds entries of a single cpu.
+ */
+enum {
+	TASKSTATS_RING_TYPE_UNSPEC = 0,	/* Reserved */
+	TASKSTATS_RING_TYPE_CPU,	/* u32, cpu of the batch */
+	TASKSTATS_RING_TYPE_ENTRIES,	/* array of taskstats_ring_entry */
+	TASKSTATS_RING_TYPE_LOST,	/* u64, entries overwritten unread */
+	__TASKSTATS_RING_TYPE_MAX,
+};
+
+#define TASKSTATS_RING_TYPE_MAX (__TASKSTATS_RING_TYPE_MAX - 1)
+
+#endif /* _LINUX_TASKSTATS_RING_H */
@@ -16,14 +16,44 @@
 #ifndef __uid_stat_h
 #define __uid_stat_h
 
+#include <linux/types.h>
+
 /* Contains definitions for resource tracking per uid. */
 
+/*
+ * /proc/uid_stat/all is an array of these, one per uid and interface.
+ * ifindex is that of the route cached on the socket, or 0 for traffic
+ * on sockets without one.  TCP packet counts are estimated from the
+ * MSS.  All fields are native endian.
+ */
+struct uid_stat_record {
+	__u32	uid;
+	__s32	ifindex;
+	__u64	rcv_bytes;
+	__u64	snd_bytes;
+	__u64	rcv_packets;
+	__u64	snd_packets;
+};
+
+#ifdef __KERNEL__
+struct sock;
+
 #ifdef CONFIG_UID_STAT
-int update_tcp_snd(uid_t uid, int size);
-int update_tcp_rcv(uid_t uid, int size);
+int update_tcp_snd(uid_t uid, struct sock *sk, int size, int packets);
+int update_tcp_rcv(uid_t uid, struct sock *sk, int size, int packets);
 #else
-#define update_tcp_snd(uid, size) do {} while (0);
-#define update_tcp_rcv(uid, size) do {} while (0);
+static inline int update_tcp_snd(uid_t uid, struct sock *sk, int size,
+				 int packets)
+{
+	return 0;
+}
+
+static inline int update_tcp_rcv(uid_t uid, struct sock *sk, int size,
+				 int packets)
+{
+	return 0;
+}
 #endif
+#endif /* __KERNEL__ */
 
 #endif /* _LINUX_UID_STAT_H */
@@ -18,6 +18,7 @@
 
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/timer.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
  * states when active. If the type is set to WAKE_LOCK_SUSPEND, the wake_lock
@@ -32,12 +33,16 @@ enum {
 	WAKE_LOCK_TYPE_COUNT
 };
 
+/* Hold times are binned by < 1ms, 10ms, 100ms, 1s, 10s, 1min, 10min, longer */
+#define WAKE_LOCK_HIST_BUCKETS	8
+
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
+	struct timer_list   timer;
 #ifdef CONFIG_PM_DEEPSLEEP
 	pid_t   pid;
 #endif
@@ -50,6 +55,8 @@ struct wake_lock {
 		ktime_t         prevent_suspend_time;
 		ktime_t         max_time;
 		ktime_t         last_time;
+		ktime_t         sleep_wait_base;
+		unsigned int    hist[WAKE_LOCK_HIST_BUCKETS];
 	} stat;
 #endif
 #endif
@@ -72,7 +79,9 @@ int wake_lock_active(struct wake_lock *lock);
 /* has_wake_lock returns 0 if no wake locks of the specified type are active,
  * and non-zero if one or more wake locks are held. Specifically it returns
  * -1 if one or more wake locks with no timeout are active or the
- * number of jiffies until all active wake locks time out.
+ * number of jiffies until all active wake locks time out. The latter is an
+ * upper bound if a lock with a timeout was released or shortened early.
+ * This does not walk the active locks, so it is cheap to call often.
  */
 long has_wake_lock(int type);
 
@@ -13,10 +13,14 @@
  *
  */
 
+#include <linux/async.h>
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
+#include <linux/hrtimer.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/seq_file.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/timer.h>
 #include <linux/wakelock.h>
@@ -45,9 +49,15 @@ module_param_named(early_suspend_queue_timeout, early_suspend_queue_timeout,
 static int late_resume_queue_timeout = 10;
 module_param_named(late_resume_queue_timeout, late_resume_queue_timeout,
 			int, S_IRUGO | S_IWUSR | S_IWGRP);
+static int parallel_handlers = 1;
+module_param_named(parallel_handlers, parallel_handlers,
+			int, S_IRUGO | S_IWUSR | S_IWGRP);
 
 static DEFINE_MUTEX(early_suspend_lock);
 static LIST_HEAD(early_suspend_handlers);
+static LIST_HEAD(early_suspend_domain);
+static unsigned int early_suspend_us;
+static unsigned int late_resume_us;
 static void early_suspend(struct work_struct *work);
 static void late_resume(struct work_struct *work);
 static void early_suspend_wd_enable(int suspend_type, void (*data), int timeout);
@@ -106,6 +116,106 @@ static void dump_process_state(int bad_pid)
 }
 
 
+static unsigned int early_suspend_elapsed_us(ktime_t start)
+{
+	return (unsigned int)ktime_to_us(ktime_sub(ktime_get(), start));
+}
+
+static void early_suspend_call(void *data, async_cookie_t cookie)
+{
+	struct early_suspend *h = data;
+	ktime_t start = ktime_get();
+
+	h->suspend(h);
+	h->suspend_us = early_suspend_elapsed_us(start);
+	if (h->suspend_us > h->max_suspend_us)
+		h->max_suspend_us = h->suspend_us;
+	h->pending = 0;
+}
+
+static void late_resume_call(void *data, async_cookie_t cookie)
+{
+	struct early_suspend *h = data;
+	ktime_t start = ktime_get();
+
+	h->resume(h);
+	h->resume_us = early_suspend_elapsed_us(start);
+	if (h->resume_us > h->max_resume_us)
+		h->max_resume_us = h->resume_us;
+	h->pending = 0;
+}
+
+/*
+ * Call the suspend (low to high level) or resume (high to low level) hooks.
+ * Handlers at the same level are handed to the async threads, except the
+ * last one which runs here, and the level is waited for before the next
+ * one starts.  The watchdog covers a whole level at a time.
+ */
+static void early_suspend_call_handlers(int suspend_type)
+{
+	struct list_head *head = &early_suspend_handlers;
+	struct list_head *p, *n;
+	struct early_suspend *pos, *next;
+	async_func_ptr *call;
+	void (*hook)(struct early_suspend *h);
+	int timeout;
+	int in_level = 0;
+
+	if (suspend_type == EARLY_SUSPEND) {
+		call = early_suspend_call;
+		timeout = early_suspend_timeout_value;
+		p = head->next;
+	} else {
+		call = late_resume_call;
+		timeout = late_resume_timeout_value;
+		p = head->prev;
+	}
+
+	for (; p != head; p = n) {
+		n = suspend_type == EARLY_SUSPEND ? p->next : p->prev;
+		pos = list_entry(p, struct early_suspend, link);
+		next = n != head ? list_entry(n, struct early_suspend, link) :
+			NULL;
+		hook = suspend_type == EARLY_SUSPEND ? pos->suspend :
+			pos->resume;
+
+		if (hook) {
+			if (!in_level) {
+				early_suspend_wd_enable(suspend_type, hook,
+					timeout);
+				in_level = 1;
+			}
+			pos->pending = 1;
+			if (parallel_handlers && next &&
+			    next->level == pos->level)
+				async_schedule_domain(call, pos,
+					&early_suspend_domain);
+			else
+				call(pos, 0);
+		}
+
+		if (in_level && (!parallel_handlers || !next ||
+				 next->level != pos->level)) {
+			async_synchronize_full_domain(&early_suspend_domain);
+			early_suspend_wd_disable(suspend_type);
+			in_level = 0;
+		}
+	}
+}
+
+static void early_suspend_dump_pending(int suspend_type)
+{
+	struct early_suspend *pos;
+
+	/* early_suspend_lock is held by the stalled work, the list is stable */
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		if (pos->pending)
+			printk(KERN_EMERG "**** still running: %pF (level %d)\n",
+				suspend_type == EARLY_SUSPEND ?
+				(void *)pos->suspend : (void *)pos->resume,
+				pos->level);
+}
+
 void register_early_suspend(struct early_suspend *handler)
 {
 	struct list_head *pos;
@@ -119,7 +229,7 @@ void register_early_suspend(struct early_suspend *handler)
 	}
 	list_add_tail(&handler->link, pos);
 	if ((state & SUSPENDED) && handler->suspend)
-		handler->suspend(handler);
+		early_suspend_call(handler, 0);
 	mutex_unlock(&early_suspend_lock);
 }
 EXPORT_SYMBOL(register_early_suspend);
@@ -134,8 +244,8 @@ EXPORT_SYMBOL(unregister_early_suspend);
 
 static void early_suspend(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t start;
 	int abort = 0;
 
 	suspend_pid = task_pid_nr(current);
@@ -158,14 +268,11 @@ static void early_suspend(struct work_struct *work)
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL) {
-			early_suspend_wd_enable(EARLY_SUSPEND, pos->suspend,
-				early_suspend_timeout_value);
-			pos->suspend(pos);
-			early_suspend_wd_disable(EARLY_SUSPEND);
-			}
-	}
+	start = ktime_get();
+	early_suspend_call_handlers(EARLY_SUSPEND);
+	early_suspend_us = early_suspend_elapsed_us(start);
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("early_suspend: done in %u us\n", early_suspend_us);
 	mutex_unlock(&early_suspend_lock);
 
 abort:
@@ -177,8 +284,8 @@ abort:
 
 static void late_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t start;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -197,15 +304,11 @@ static void late_resume(struct work_struct *work)
 	}
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link)
-		if (pos->resume != NULL) {
-			early_suspend_wd_enable(LATE_RESUME, pos->resume,
-				late_resume_timeout_value);
-			pos->resume(pos);
-			early_suspend_wd_disable(LATE_RESUME);
-			}
+	start = ktime_get();
+	early_suspend_call_handlers(LATE_RESUME);
+	late_resume_us = early_suspend_elapsed_us(start);
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("late_resume: done\n");
+		pr_info("late_resume: done in %u us\n", late_resume_us);
 abort:
 	mutex_unlock(&early_suspend_lock);
 }
@@ -263,6 +366,7 @@ static void early_suspend_timeout(unsigned long data)
 			" %pF, state: %d, requested state: %d.\n",
 			(void *)data, state, requested_suspend_state);
 
+	early_suspend_dump_pending(EARLY_SUSPEND);
 	dump_process_state(s_nvrm_daemon_pid);
 	dump_process_state(suspend_pid);
 	tombstone_timeout(0);
@@ -281,6 +385,7 @@ static void late_resume_timeout(unsigned long data)
 			" %pF, state: %d, requested state: %d.\n",
 			(void *)data, state, requested_suspend_state);
 
+	early_suspend_dump_pending(LATE_RESUME);
 	dump_process_state(s_nvrm_daemon_pid);
 	dump_process_state(suspend_pid);
 	tombstone_timeout(0);
@@ -348,3 +453,45 @@ static void early_suspend_wd_disable(int suspend_type)
                         pr_info("Late Resume watchdog stopped.\n");
 	}
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int early_suspend_stats_show(struct seq_file *m, void *unused)
+{
+	struct early_suspend *pos;
+
+	mutex_lock(&early_suspend_lock);
+	seq_printf(m, "early_suspend: %u us\nlate_resume: %u us\n\n",
+		   early_suspend_us, late_resume_us);
+	seq_printf(m, "%-6s %10s %10s %10s %10s  %s\n", "level",
+		   "suspend", "max", "resume", "max", "handler (us)");
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		seq_printf(m, "%-6d %10u %10u %10u %10u  %pF\n", pos->level,
+			   pos->suspend_us, pos->max_suspend_us,
+			   pos->resume_us, pos->max_resume_us,
+			   pos->suspend ? (void *)pos->suspend :
+			   (void *)pos->resume);
+	mutex_unlock(&early_suspend_lock);
+	return 0;
+}
+
+static int early_suspend_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_stats_show, NULL);
+}
+
+static const struct file_operations early_suspend_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = early_suspend_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init early_suspend_debugfs_init(void)
+{
+	debugfs_create_file("early_suspend_stats", S_IRUGO, NULL, NULL,
+			    &early_suspend_stats_fops);
+	return 0;
+}
+late_initcall(early_suspend_debugfs_init);
+#endif
@@ -38,11 +38,19 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 #define WAKE_LOCK_INITIALIZED            (1U << 8)
 #define WAKE_LOCK_ACTIVE                 (1U << 9)
 #define WAKE_LOCK_AUTO_EXPIRE            (1U << 10)
-#define WAKE_LOCK_PREVENTING_SUSPEND     (1U << 11)
 
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/*
+ * Active locks of each type, so has_wake_lock() need not walk the lists.
+ * Locks with a timeout expire from their own timer.
+ */
+static struct {
+	int untimed;
+	int timed;
+	unsigned long expires;	/* no timed lock expires later than this */
+} active_count[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
@@ -51,9 +59,15 @@ static struct wake_lock unknown_wakeup;
 
 #ifdef CONFIG_WAKELOCK_STAT
 static struct wake_lock deleted_wake_locks;
-static ktime_t last_sleep_time_update;
+static ktime_t sleep_wait_total;
+static ktime_t sleep_wait_start;
 static int wait_for_wakeup;
 
+/* Upper bound in ms of each wake time histogram bucket but the last */
+static const unsigned int wake_lock_hist_ms[WAKE_LOCK_HIST_BUCKETS - 1] = {
+	1, 10, 100, 1000, 10000, 60000, 600000
+};
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -80,6 +94,30 @@ int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 	return 1;
 }
 
+/*
+ * Total time spent waiting to suspend, i.e. with the main wake lock released,
+ * up to now.  A suspend lock held from a to b kept the system awake for
+ * sleep_wait_clock(b) - sleep_wait_clock(a), which avoids walking the active
+ * locks each time the main lock changes state.
+ */
+static ktime_t sleep_wait_clock(ktime_t now)
+{
+	if (wake_lock_active(&main_wake_lock) ||
+	    now.tv64 < sleep_wait_start.tv64)
+		return sleep_wait_total;
+	return ktime_add(sleep_wait_total, ktime_sub(now, sleep_wait_start));
+}
+
+static void wake_lock_hist_add(struct wake_lock *lock, ktime_t duration)
+{
+	s64 ns = ktime_to_ns(duration);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(wake_lock_hist_ms); i++)
+		if (ns < (s64)wake_lock_hist_ms[i] * NSEC_PER_MSEC)
+			break;
+	lock->stat.hist[i]++;
+}
 
 static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 {
@@ -88,8 +126,9 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 	ktime_t active_time = ktime_set(0, 0);
 	ktime_t total_time = lock->stat.total_time;
 	ktime_t max_time = lock->stat.max_time;
-
 	ktime_t prevent_suspend_time = lock->stat.prevent_suspend_time;
+	int i;
+
 	if (lock->flags & WAKE_LOCK_ACTIVE) {
 		ktime_t now, add_time;
 		int expired = get_expired_time(lock, &now);
@@ -102,20 +141,23 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		else
 			expire_count++;
 		total_time = ktime_add(total_time, add_time);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
+		if ((lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND)
 			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+					ktime_sub(sleep_wait_clock(now),
+						  lock->stat.sleep_wait_base));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
 
-	return seq_printf(m,
-		     "\"%s\"\t%d\t%d\t%d\t%lld\t%lld\t%lld\t%lld\t%lld\n",
+	seq_printf(m, "\"%s\"\t%d\t%d\t%d\t%lld\t%lld\t%lld\t%lld\t%lld",
 		     lock->name, lock_count, expire_count,
 		     lock->stat.wakeup_count, ktime_to_ns(active_time),
 		     ktime_to_ns(total_time),
 		     ktime_to_ns(prevent_suspend_time), ktime_to_ns(max_time),
 		     ktime_to_ns(lock->stat.last_time));
+	for (i = 0; i < WAKE_LOCK_HIST_BUCKETS; i++)
+		seq_printf(m, "%c%u", i ? ',' : '\t', lock->stat.hist[i]);
+	return seq_putc(m, '\n');
 }
 
 static int wakelock_stats_show(struct seq_file *m, void *unused)
@@ -128,7 +170,8 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	spin_lock_irqsave(&list_lock, irqflags);
 
 	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
-			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
+			"\ttotal_time\tsleep_time\tmax_time\tlast_change"
+			"\thist\n");
 	list_for_each_entry(lock, &inactive_locks, link)
 		ret = print_lock_stat(m, lock);
 	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
@@ -157,51 +200,41 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
+	wake_lock_hist_add(lock, duration);
 	lock->stat.last_time = ktime_get();
-	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
+	if ((lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND)
 		lock->stat.prevent_suspend_time = ktime_add(
-			lock->stat.prevent_suspend_time, duration);
-		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+			lock->stat.prevent_suspend_time,
+			ktime_sub(sleep_wait_clock(now),
+				  lock->stat.sleep_wait_base));
 }
+#endif
 
-static void update_sleep_wait_stats_locked(int done)
+/* Caller must acquire the list_lock spinlock */
+static void deactivate_wake_lock(struct wake_lock *lock, int expired)
 {
-	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
-	int expired;
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
 
-	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
+	if (lock->flags & WAKE_LOCK_ACTIVE) {
+#ifdef CONFIG_WAKELOCK_STAT
+		wake_unlock_stat_locked(lock, expired);
+#endif
+		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+			active_count[type].timed--;
 		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
+			active_count[type].untimed--;
+		lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
+#ifdef CONFIG_WAKELOCK_STAT
+		if (lock == &main_wake_lock)
+			sleep_wait_start = ktime_get();
+#endif
 	}
-	last_sleep_time_update = now;
+	list_move(&lock->link, &inactive_locks);
 }
-#endif
-
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
-#ifdef CONFIG_WAKELOCK_STAT
-	wake_unlock_stat_locked(lock, 1);
-#endif
-	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
-	list_add(&lock->link, &inactive_locks);
+	deactivate_wake_lock(lock, 1);
 	if (debug_mask & (DEBUG_WAKE_LOCK | DEBUG_EXPIRE))
 		pr_info("expired wake lock %s\n", lock->name);
 }
@@ -242,32 +275,33 @@ void dump_active_lock_static(void)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	long timeout;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
-	}
-	return max_timeout;
+	if (active_count[type].untimed)
+		return -1;
+	if (!active_count[type].timed)
+		return 0;
+	/* an expired lock whose timer has not run yet still counts */
+	timeout = active_count[type].expires - jiffies;
+	return timeout > 0 ? timeout : 1;
 }
 
 long has_wake_lock(int type)
 {
 	long ret;
 	unsigned long irqflags;
-	spin_lock_irqsave(&list_lock, irqflags);
+
+	/*
+	 * The counts only change under list_lock, but a racy read is fine:
+	 * whoever drops the last lock re-checks under it and queues suspend.
+	 */
 	ret = has_wake_lock_locked(type);
-	if (ret && (debug_mask & DEBUG_WAKEUP) && type == WAKE_LOCK_SUSPEND)
+	if (ret && (debug_mask & DEBUG_WAKEUP) && type == WAKE_LOCK_SUSPEND) {
+		spin_lock_irqsave(&list_lock, irqflags);
 		print_active_locks(type);
-	spin_unlock_irqrestore(&list_lock, irqflags);
+		spin_unlock_irqrestore(&list_lock, irqflags);
+	}
 	return ret;
 }
 
@@ -304,23 +338,26 @@ static void suspend(struct work_struct *work)
 }
 static DECLARE_WORK(suspend_work, suspend);
 
-static void expire_wake_locks(unsigned long data)
+static void expire_wake_lock_timer(unsigned long data)
 {
-	long has_lock;
+	struct wake_lock *lock = (struct wake_lock *)data;
 	unsigned long irqflags;
-	if (debug_mask & DEBUG_EXPIRE)
-		pr_info("expire_wake_locks: start\n");
+
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (debug_mask & DEBUG_SUSPEND)
-		print_active_locks(WAKE_LOCK_SUSPEND);
-	has_lock = has_wake_lock_locked(WAKE_LOCK_SUSPEND);
-	if (debug_mask & DEBUG_EXPIRE)
-		pr_info("expire_wake_locks: done, has_lock %ld\n", has_lock);
-	if (has_lock == 0)
-		queue_work(suspend_work_queue, &suspend_work);
+	/* it may have been unlocked or relocked since the timer was set */
+	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+	    (long)(lock->expires - jiffies) <= 0) {
+		expire_wake_lock(lock);
+		if ((lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND &&
+		    !has_wake_lock_locked(WAKE_LOCK_SUSPEND)) {
+			if (debug_mask & DEBUG_EXPIRE)
+				pr_info("expire_wake_lock_timer: %s, "
+					"no locks left\n", lock->name);
+			queue_work(suspend_work_queue, &suspend_work);
+		}
+	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
-static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
 
 static int power_suspend_late(struct device *dev)
 {
@@ -363,8 +400,10 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
 	lock->stat.last_time = ktime_set(0, 0);
+	memset(lock->stat.hist, 0, sizeof(lock->stat.hist));
 #endif
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
+	setup_timer(&lock->timer, expire_wake_lock_timer, (unsigned long)lock);
 
 	INIT_LIST_HEAD(&lock->link);
 	spin_lock_irqsave(&list_lock, irqflags);
@@ -376,9 +415,14 @@ EXPORT_SYMBOL(wake_lock_init);
 void wake_lock_destroy(struct wake_lock *lock)
 {
 	unsigned long irqflags;
+#ifdef CONFIG_WAKELOCK_STAT
+	int i;
+#endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
+	del_timer_sync(&lock->timer);
 	spin_lock_irqsave(&list_lock, irqflags);
+	deactivate_wake_lock(lock, 0);
 	lock->flags &= ~WAKE_LOCK_INITIALIZED;
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
@@ -393,6 +437,8 @@ void wake_lock_destroy(struct wake_lock *lock)
 		deleted_wake_locks.stat.max_time =
 			ktime_add(deleted_wake_locks.stat.max_time,
 				  lock->stat.max_time);
+		for (i = 0; i < WAKE_LOCK_HIST_BUCKETS; i++)
+			deleted_wake_locks.stat.hist[i] += lock->stat.hist[i];
 	}
 #endif
 	list_del(&lock->link);
@@ -405,7 +451,6 @@ static void wake_lock_internal(
 {
 	int type;
 	unsigned long irqflags;
-	long expire_in;
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
@@ -418,18 +463,26 @@ static void wake_lock_internal(
 		wait_for_wakeup = 0;
 		lock->stat.wakeup_count++;
 	}
-	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
-	    (long)(lock->expires - jiffies) <= 0) {
-		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
-	}
 #endif
+	/* account the expired hold before starting a new one */
+	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+	    (long)(lock->expires - jiffies) <= 0)
+		expire_wake_lock(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
+#ifdef CONFIG_WAKELOCK_STAT
+		if (lock == &main_wake_lock)
+			sleep_wait_total = sleep_wait_clock(ktime_get());
+#endif
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
 		lock->stat.last_time = ktime_get();
+		lock->stat.sleep_wait_base =
+			sleep_wait_clock(lock->stat.last_time);
 #endif
-	}
+	} else if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		active_count[type].timed--;
+	else
+		active_count[type].untimed--;
 	list_del(&lock->link);
 	if (has_timeout) {
 		if (debug_mask & DEBUG_WAKE_LOCK)
@@ -439,42 +492,24 @@ static void wake_lock_internal(
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
 		list_add_tail(&lock->link, &active_wake_locks[type]);
+		if (!active_count[type].timed++ ||
+		    time_after(lock->expires, active_count[type].expires))
+			active_count[type].expires = lock->expires;
+		mod_timer(&lock->timer, lock->expires);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
+		active_count[type].untimed++;
+		del_timer(&lock->timer);
 	}
 #ifdef CONFIG_PM_DEEPSLEEP
 	lock->pid = current->tgid;
 #endif
-	if (type == WAKE_LOCK_SUSPEND) {
+	if (type == WAKE_LOCK_SUSPEND)
 		current_event_num++;
-#ifdef CONFIG_WAKELOCK_STAT
-		if (lock == &main_wake_lock)
-			update_sleep_wait_stats_locked(1);
-		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
-#endif
-		if (has_timeout)
-			expire_in = has_wake_lock_locked(type);
-		else
-			expire_in = -1;
-		if (expire_in > 0) {
-			if (debug_mask & DEBUG_EXPIRE)
-				pr_info("wake_lock: %s, start expire timer, "
-					"%ld\n", lock->name, expire_in);
-			mod_timer(&expire_timer, jiffies + expire_in);
-		} else {
-			if (del_timer(&expire_timer))
-				if (debug_mask & DEBUG_EXPIRE)
-					pr_info("wake_lock: %s, stop expire timer\n",
-						lock->name);
-			if (expire_in == 0)
-				queue_work(suspend_work_queue, &suspend_work);
-		}
-	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 
@@ -496,36 +531,16 @@ void wake_unlock(struct wake_lock *lock)
 	unsigned long irqflags;
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
-#ifdef CONFIG_WAKELOCK_STAT
-	wake_unlock_stat_locked(lock, 0);
-#endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
-	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
-	list_add(&lock->link, &inactive_locks);
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		del_timer(&lock->timer);
+	deactivate_wake_lock(lock, 0);
 	if (type == WAKE_LOCK_SUSPEND) {
-		long has_lock = has_wake_lock_locked(type);
-		if (has_lock > 0) {
-			if (debug_mask & DEBUG_EXPIRE)
-				pr_info("wake_unlock: %s, start expire timer, "
-					"%ld\n", lock->name, has_lock);
-			mod_timer(&expire_timer, jiffies + has_lock);
-		} else {
-			if (del_timer(&expire_timer))
-				if (debug_mask & DEBUG_EXPIRE)
-					pr_info("wake_unlock: %s, stop expire "
-						"timer\n", lock->name);
-			if (has_lock == 0)
-				queue_work(suspend_work_queue, &suspend_work);
-		}
-		if (lock == &main_wake_lock) {
-			if (debug_mask & DEBUG_SUSPEND)
-				print_active_locks(WAKE_LOCK_SUSPEND);
-#ifdef CONFIG_WAKELOCK_STAT
-			update_sleep_wait_stats_locked(0);
-#endif
-		}
+		if (lock == &main_wake_lock && (debug_mask & DEBUG_SUSPEND))
+			print_active_locks(WAKE_LOCK_SUSPEND);
+		if (!has_wake_lock_locked(type))
+			queue_work(suspend_work_queue, &suspend_work);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
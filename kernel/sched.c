@@ -64,6 +64,7 @@
 #include <linux/tsacct_kern.h>
 #include <linux/kprobes.h>
 #include <linux/delayacct.h>
+#include <linux/taskstats_kern.h>
 #include <linux/unistd.h>
 #include <linux/pagemap.h>
 #include <linux/hrtimer.h>
@@ -77,6 +78,7 @@
 
 #include "sched_cpupri.h"
 #include "sched_autogroup.h"
+#include "workqueue_sched.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/sched.h>
@@ -5733,6 +5735,29 @@ pick_next_task(struct rq *rq)
 	}
 }
 
+/*
+ * A workqueue pool worker that blocks lets its pool know, so that
+ * another worker can pick up the pending work.  Preemption is kept
+ * off so that the notification can't be undone by a nested preempt
+ * before we actually switch away.
+ */
+static inline void sched_submit_work(struct task_struct *tsk)
+{
+	if (!tsk->state || (preempt_count() & PREEMPT_ACTIVE) ||
+	    !(tsk->flags & PF_WQ_WORKER))
+		return;
+
+	preempt_disable();
+	wq_worker_sleeping(tsk);
+	preempt_enable_no_resched();
+}
+
+static inline void sched_update_worker(struct task_struct *tsk)
+{
+	if (tsk->flags & PF_WQ_WORKER)
+		wq_worker_running(tsk);
+}
+
 /*
  * schedule() is the main scheduler function.
  */
@@ -5743,6 +5768,7 @@ asmlinkage void __sched schedule(void)
 	struct rq *rq;
 	int cpu;
 
+	sched_submit_work(current);
 need_resched:
 	preempt_disable();
 	cpu = smp_processor_id();
@@ -5789,6 +5815,7 @@ need_resched_nonpreemptible:
 		smp_wmb();
 #endif
 		++*switch_count;
+		taskstats_ring_switch(prev, rq->clock);
 
 		context_switch(rq, prev, next); /* unlocks the rq */
 		/*
@@ -5808,6 +5835,8 @@ need_resched_nonpreemptible:
 	preempt_enable_no_resched();
 	if (need_resched())
 		goto need_resched;
+
+	sched_update_worker(current);
 }
 EXPORT_SYMBOL(schedule);
 
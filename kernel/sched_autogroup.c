@@ -4,8 +4,34 @@
 #include <linux/seq_file.h>
 #include <linux/kallsyms.h>
 #include <linux/utsname.h>
+#include <linux/hash.h>
+
+/*
+ * sched_autogroup_mode picks what a new autogroup is keyed on:
+ *
+ *  session:	a group per session, created by setsid()
+ *  uid:	a group per uid, joined when a process changes its uid
+ *  app:	a group per process which changes its uid, which on Android
+ *		is every app process forked off zygote
+ *
+ * Groups of the last two modes also follow the foreground/background
+ * state of their app, as told by the oom_adj the activity manager
+ * assigns: processes at or below sched_autogroup_fg_oom_adj get
+ * sched_autogroup_fg_shares, the others sched_autogroup_bg_shares.
+ * Changing the mode only affects groups created afterwards.
+ */
+enum {
+	AUTOGROUP_MODE_SESSION,
+	AUTOGROUP_MODE_UID,
+	AUTOGROUP_MODE_APP,
+};
 
 unsigned int __read_mostly sysctl_sched_autogroup_enabled = 1;
+unsigned int __read_mostly sysctl_sched_autogroup_mode = AUTOGROUP_MODE_SESSION;
+unsigned int __read_mostly sysctl_sched_autogroup_fg_shares = NICE_0_LOAD;
+/* The cpu.shares of Android's bg_non_interactive cgroup */
+unsigned int __read_mostly sysctl_sched_autogroup_bg_shares = 52;
+int __read_mostly sysctl_sched_autogroup_fg_oom_adj = 1;
 
 struct autogroup {
 	struct task_group	*tg;
@@ -13,11 +39,23 @@ struct autogroup {
 	struct rw_semaphore 	lock;
 	unsigned long		id;
 	int			nice;
+	int			app;		/* follows fg/bg state */
+	int			background;
+	uid_t			uid;
+	struct hlist_node	uid_node;	/* uid mode only */
+	struct list_head	list;		/* on autogroup_list */
 };
 
 static struct autogroup autogroup_default;
 static atomic_t autogroup_seq_nr;
 
+#define AUTOGROUP_HASH_BITS	6
+
+/* Protects autogroup_list and autogroup_uid_hash */
+static DEFINE_SPINLOCK(autogroup_lock);
+static LIST_HEAD(autogroup_list);
+static struct hlist_head autogroup_uid_hash[1 << AUTOGROUP_HASH_BITS];
+
 static void autogroup_init(struct task_struct *init_task)
 {
 	autogroup_default.tg = &init_task_group;
@@ -31,6 +69,13 @@ static inline void autogroup_destroy(struct kref *kref)
 {
 	struct autogroup *ag = container_of(kref, struct autogroup, kref);
 	struct task_group *tg = ag->tg;
+	unsigned long flags;
+
+	spin_lock_irqsave(&autogroup_lock, flags);
+	list_del(&ag->list);
+	if (!hlist_unhashed(&ag->uid_node))
+		hlist_del(&ag->uid_node);
+	spin_unlock_irqrestore(&autogroup_lock, flags);
 
 	kfree(ag);
 	sched_destroy_group(tg);
@@ -47,6 +92,12 @@ static inline struct autogroup *autogroup_kref_get(struct autogroup *ag)
 	return ag;
 }
 
+/* For lookups under autogroup_lock, which may find a dying group */
+static inline int autogroup_kref_get_live(struct autogroup *ag)
+{
+	return atomic_inc_not_zero(&ag->kref.refcount);
+}
+
 static inline struct autogroup *autogroup_create(void)
 {
 	struct autogroup *ag = kzalloc(sizeof(*ag), GFP_KERNEL);
@@ -63,6 +114,11 @@ static inline struct autogroup *autogroup_create(void)
 	kref_init(&ag->kref);
 	init_rwsem(&ag->lock);
 	ag->id = atomic_inc_return(&autogroup_seq_nr);
+	INIT_HLIST_NODE(&ag->uid_node);
+
+	spin_lock_irq(&autogroup_lock);
+	list_add(&ag->list, &autogroup_list);
+	spin_unlock_irq(&autogroup_lock);
 
 	return ag;
 
@@ -132,6 +188,59 @@ autogroup_move_group(struct task_struct *p, struct autogroup *ag)
 	autogroup_kref_put(prev);
 }
 
+/*
+ * Set the group's shares from its nice level, scaled by the fg or bg
+ * shares for app groups.  Called with ag->lock held for writing.
+ */
+static int autogroup_set_shares(struct autogroup *ag)
+{
+	u64 shares = prio_to_weight[ag->nice + 20];
+
+	if (ag->app) {
+		unsigned int scale = ag->background ?
+			ACCESS_ONCE(sysctl_sched_autogroup_bg_shares) :
+			ACCESS_ONCE(sysctl_sched_autogroup_fg_shares);
+
+		shares = (shares * scale) >> NICE_0_SHIFT;
+	}
+
+	return sched_group_set_shares(ag->tg, min_t(u64, shares, MAX_SHARES));
+}
+
+/* Find, or else create, the group of @uid.  Allocates GFP_KERNEL. */
+static struct autogroup *autogroup_uid_get(uid_t uid)
+{
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct autogroup *ag, *new = NULL;
+
+	head = &autogroup_uid_hash[hash_long(uid, AUTOGROUP_HASH_BITS)];
+again:
+	spin_lock_irq(&autogroup_lock);
+	hlist_for_each_entry(ag, node, head, uid_node) {
+		if (ag->uid == uid && autogroup_kref_get_live(ag)) {
+			spin_unlock_irq(&autogroup_lock);
+			/* somebody beat us to it */
+			if (new)
+				autogroup_kref_put(new);
+			return ag;
+		}
+	}
+	if (new) {
+		hlist_add_head(&new->uid_node, head);
+		spin_unlock_irq(&autogroup_lock);
+		return new;
+	}
+	spin_unlock_irq(&autogroup_lock);
+
+	new = autogroup_create();
+	if (new == &autogroup_default)
+		return new;
+	new->uid = uid;
+	new->app = 1;
+	goto again;
+}
+
 /* Allocates GFP_KERNEL, cannot be called under any spinlock */
 void sched_autogroup_create_attach(struct task_struct *p)
 {
@@ -143,6 +252,112 @@ void sched_autogroup_create_attach(struct task_struct *p)
 }
 EXPORT_SYMBOL(sched_autogroup_create_attach);
 
+/* Called by setsid() */
+void sched_autogroup_setsid(struct task_struct *p)
+{
+	if (ACCESS_ONCE(sysctl_sched_autogroup_mode) == AUTOGROUP_MODE_SESSION)
+		sched_autogroup_create_attach(p);
+}
+
+/* Called when @p, which must be current, changed its real uid */
+void sched_autogroup_setuid(struct task_struct *p)
+{
+	struct autogroup *ag;
+
+	switch (ACCESS_ONCE(sysctl_sched_autogroup_mode)) {
+	case AUTOGROUP_MODE_UID:
+		ag = autogroup_uid_get(task_uid(p));
+		break;
+	case AUTOGROUP_MODE_APP:
+		ag = autogroup_create();
+		if (ag != &autogroup_default)
+			ag->app = 1;
+		break;
+	default:
+		return;
+	}
+
+	if (ag->app) {
+		down_write(&ag->lock);
+		autogroup_set_shares(ag);
+		up_write(&ag->lock);
+	}
+
+	autogroup_move_group(p, ag);
+	autogroup_kref_put(ag);
+}
+
+static inline struct autogroup *autogroup_get(struct task_struct *p)
+{
+	struct autogroup *ag;
+	unsigned long flags;
+
+	/* task may be moved after we unlock.. tough */
+	if (!lock_task_sighand(p, &flags))
+		return autogroup_kref_get(&autogroup_default);
+	ag = autogroup_kref_get(p->signal->autogroup);
+	unlock_task_sighand(p, &flags);
+
+	return ag;
+}
+
+/* Called when the oom_adj of @p was set, switches its group fg/bg */
+void sched_autogroup_oom_adj(struct task_struct *p, int oom_adj)
+{
+	struct autogroup *ag = autogroup_get(p);
+	int background = oom_adj > ACCESS_ONCE(sysctl_sched_autogroup_fg_oom_adj);
+
+	if (ag->app) {
+		down_write(&ag->lock);
+		if (ag->background != background) {
+			ag->background = background;
+			autogroup_set_shares(ag);
+		}
+		up_write(&ag->lock);
+	}
+
+	autogroup_kref_put(ag);
+}
+
+int sched_autogroup_shares_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *lenp,
+		loff_t *ppos)
+{
+	struct autogroup *ag, *prev = NULL;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (ret || !write)
+		return ret;
+
+	/*
+	 * Our reference keeps ag on the list while we drop the lock to
+	 * update it, it's put once we've moved on.
+	 */
+	spin_lock_irq(&autogroup_lock);
+	list_for_each_entry(ag, &autogroup_list, list) {
+		if (!ag->app || !autogroup_kref_get_live(ag))
+			continue;
+		spin_unlock_irq(&autogroup_lock);
+
+		if (prev)
+			autogroup_kref_put(prev);
+		prev = ag;
+
+		down_write(&ag->lock);
+		autogroup_set_shares(ag);
+		up_write(&ag->lock);
+
+		spin_lock_irq(&autogroup_lock);
+	}
+	spin_unlock_irq(&autogroup_lock);
+
+	if (prev)
+		autogroup_kref_put(prev);
+
+	return 0;
+}
+
 /* Cannot be called under siglock.  Currently has no users */
 void sched_autogroup_detach(struct task_struct *p)
 {
@@ -175,23 +390,11 @@ __setup("noautogroup", setup_autogroup);
 
 #ifdef CONFIG_PROC_FS
 
-static inline struct autogroup *autogroup_get(struct task_struct *p)
-{
-	struct autogroup *ag;
-
-	/* task may be moved after we unlock.. tough */
-	spin_lock(&p->sighand->siglock);
-	ag = autogroup_kref_get(p->signal->autogroup);
-	spin_unlock(&p->sighand->siglock);
-
-	return ag;
-}
-
 int proc_sched_autogroup_set_nice(struct task_struct *p, int *nice)
 {
 	static unsigned long next = INITIAL_JIFFIES;
 	struct autogroup *ag;
-	int err;
+	int err, prev;
 
 	if (*nice < -20 || *nice > 19)
 		return -EINVAL;
@@ -211,9 +414,11 @@ int proc_sched_autogroup_set_nice(struct task_struct *p, int *nice)
 	ag = autogroup_get(p);
 
 	down_write(&ag->lock);
-	err = sched_group_set_shares(ag->tg, prio_to_weight[*nice + 20]);
-	if (!err)
-		ag->nice = *nice;
+	prev = ag->nice;
+	ag->nice = *nice;
+	err = autogroup_set_shares(ag);
+	if (err)
+		ag->nice = prev;
 	up_write(&ag->lock);
 
 	autogroup_kref_put(ag);
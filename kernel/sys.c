@@ -556,6 +556,21 @@ error:
 	return retval;
 }
 
+/*
+ * Commit new credentials of a set*uid() call, letting the scheduler
+ * regroup the caller if its real uid changed.
+ */
+static int commit_uid_creds(struct cred *new)
+{
+	uid_t old_uid = current_uid();
+	int retval;
+
+	retval = commit_creds(new);
+	if (!retval && current_uid() != old_uid)
+		sched_autogroup_setuid(current);
+	return retval;
+}
+
 /*
  * change the user struct in a credentials set to match the new UID
  */
@@ -641,7 +656,7 @@ SYSCALL_DEFINE2(setreuid, uid_t, ruid, uid_t, euid)
 	if (retval < 0)
 		goto error;
 
-	return commit_creds(new);
+	return commit_uid_creds(new);
 
 error:
 	abort_creds(new);
@@ -692,7 +707,7 @@ SYSCALL_DEFINE1(setuid, uid_t, uid)
 	if (retval < 0)
 		goto error;
 
-	return commit_creds(new);
+	return commit_uid_creds(new);
 
 error:
 	abort_creds(new);
@@ -750,7 +765,7 @@ SYSCALL_DEFINE3(setresuid, uid_t, ruid, uid_t, euid, uid_t, suid)
 	if (retval < 0)
 		goto error;
 
-	return commit_creds(new);
+	return commit_uid_creds(new);
 
 error:
 	abort_creds(new);
@@ -1108,7 +1123,7 @@ out:
 	write_unlock_irq(&tasklist_lock);
 	if (err > 0) {
 		proc_sid_connector(group_leader);
-		sched_autogroup_create_attach(group_leader);
+		sched_autogroup_setsid(group_leader);
 	}
 	return err;
 }
@@ -23,6 +23,7 @@
 #include <linux/cpumask.h>
 #include <linux/percpu.h>
 #include <linux/cgroupstats.h>
+#include <linux/taskstats_ring.h>
 #include <linux/cgroup.h>
 #include <linux/fs.h>
 #include <linux/file.h>
@@ -601,6 +602,20 @@ static struct genl_ops cgroupstats_ops = {
 	.policy		= cgroupstats_cmd_get_policy,
 };
 
+#ifdef CONFIG_TASKSTATS_RING
+static int taskstats_ring_dumpit(struct sk_buff *skb,
+				 struct netlink_callback *cb)
+{
+	return taskstats_ring_dump(skb, cb, &family);
+}
+
+static struct genl_ops taskstats_ring_ops = {
+	.cmd		= TASKSTATS_RING_CMD_GET,
+	.dumpit		= taskstats_ring_dumpit,
+	.flags		= GENL_ADMIN_PERM,
+};
+#endif
+
 /* Needed early in initialization */
 void __init taskstats_init_early(void)
 {
@@ -629,9 +644,19 @@ static int __init taskstats_init(void)
 	if (rc < 0)
 		goto err_cgroup_ops;
 
+#ifdef CONFIG_TASKSTATS_RING
+	rc = genl_register_ops(&family, &taskstats_ring_ops);
+	if (rc < 0)
+		goto err_ring_ops;
+#endif
+
 	family_registered = 1;
 	printk("registered taskstats version %d\n", TASKSTATS_GENL_VERSION);
 	return 0;
+#ifdef CONFIG_TASKSTATS_RING
+err_ring_ops:
+	genl_unregister_ops(&family, &cgroupstats_ops);
+#endif
 err_cgroup_ops:
 	genl_unregister_ops(&family, &taskstats_ops);
 err:
@@ -0,0 +1,336 @@
+/*
+ * taskstats_ring.c - per-task scheduling accounting ring
+ *
+ * Every context switch logs a small entry for the task being switched
+ * out into a ring of the cpu, and userspace drains the rings in binary
+ * batches with a TASKSTATS_RING_CMD_GET dump of the taskstats family.
+ * The entry is filled from counters the scheduler, delay accounting and
+ * the fault handler keep anyway, so logging is a few dozen stores and
+ * cheap enough to leave enabled.
+ *
+ * The rings are overwriting: when the reader falls behind, the oldest
+ * entries are lost and the number lost is reported with the next batch.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/taskstats_kern.h>
+#include <linux/taskstats_ring.h>
+#include <linux/hardirq.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/gfp.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/microbench.h>
+#include <linux/vmalloc.h>
+#include <net/genetlink.h>
+
+#define TASKSTATS_RING_ENTRIES	1024	/* per cpu, must be a power of 2 */
+#define TASKSTATS_RING_MASK	(TASKSTATS_RING_ENTRIES - 1)
+
+struct taskstats_ring {
+	struct taskstats_ring_entry *entries;
+	unsigned long head;		/* next entry written, by the cpu */
+	unsigned long tail;		/* next entry read, by the dump */
+	u64 lost;			/* overwritten before being read */
+};
+
+static DEFINE_PER_CPU(struct taskstats_ring, taskstats_rings);
+
+static inline u8 taskstats_ring_state(struct task_struct *p)
+{
+	if (!p->state || (preempt_count() & PREEMPT_ACTIVE))
+		return TASKSTATS_RING_STATE_PREEMPTED;
+	if (p->in_iowait)
+		return TASKSTATS_RING_STATE_IOWAIT;
+	if (p->state & TASK_INTERRUPTIBLE)
+		return TASKSTATS_RING_STATE_SLEEPING;
+	if (p->state & TASK_UNINTERRUPTIBLE)
+		return TASKSTATS_RING_STATE_BLOCKED;
+	return TASKSTATS_RING_STATE_OTHER;
+}
+
+static inline void taskstats_ring_log(struct taskstats_ring *ring,
+				      struct task_struct *p, u64 now)
+{
+	unsigned long head = ring->head;
+	struct taskstats_ring_entry *e =
+		&ring->entries[head & TASKSTATS_RING_MASK];
+
+	e->timestamp = now;
+	e->pid = p->pid;
+	e->tgid = p->tgid;
+	e->run_time = p->se.sum_exec_runtime >> 10;
+	e->run_delay = p->sched_info.run_delay >> 10;
+	e->io_delay = p->delays ?
+		(p->delays->blkio_delay + p->delays->swapin_delay) >> 10 : 0;
+	e->nvcsw = p->nvcsw;
+	e->nivcsw = p->nivcsw;
+	e->migrations = p->se.nr_migrations;
+	e->min_flt = p->min_flt;
+	e->maj_flt = p->maj_flt;
+	e->cpu = task_cpu(p);
+	e->state = taskstats_ring_state(p);
+
+	/* publish the entry before the dump can see it */
+	smp_wmb();
+	ring->head = head + 1;
+}
+
+/*
+ * Called by schedule() with the runqueue locked and interrupts disabled
+ * when @prev is switched out.  @now is the runqueue clock.
+ */
+void taskstats_ring_switch(struct task_struct *prev, u64 now)
+{
+	struct taskstats_ring *ring = &__get_cpu_var(taskstats_rings);
+
+	if (likely(ring->entries))
+		taskstats_ring_log(ring, prev, now);
+}
+
+/*
+ * Put one batch of @cpu's entries, up to @end, into @skb.  Returns the
+ * number of entries consumed, 0 when there are none left before @end,
+ * or -EMSGSIZE when @skb has no room for another batch.
+ *
+ * Entries are copied while the cpu may be overwriting them, so head is
+ * read again afterwards and the batch is dropped if the writer lapped
+ * the copied range; the next call then resumes past the damage.
+ */
+static int taskstats_ring_put(struct sk_buff *skb, struct netlink_callback *cb,
+			      struct genl_family *family, int cpu,
+			      unsigned long end)
+{
+	struct taskstats_ring *ring = &per_cpu(taskstats_rings, cpu);
+	struct taskstats_ring_entry *dst;
+	unsigned long tail = ring->tail, head, first, n, i;
+	struct nlattr *na;
+	void *reply;
+	int room;
+
+	if ((long)(end - tail) > TASKSTATS_RING_ENTRIES) {
+		ring->lost += end - tail - TASKSTATS_RING_ENTRIES;
+		tail = end - TASKSTATS_RING_ENTRIES;
+	}
+	if ((long)(end - tail) <= 0)
+		return 0;
+
+	reply = genlmsg_put(skb, NETLINK_CB(cb->skb).pid, cb->nlh->nlmsg_seq,
+			    family, NLM_F_MULTI, TASKSTATS_RING_CMD_NEW);
+	if (!reply)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(skb, TASKSTATS_RING_TYPE_CPU, cpu))
+		goto cancel;
+	if (ring->lost && nla_put_u64(skb, TASKSTATS_RING_TYPE_LOST,
+				      ring->lost))
+		goto cancel;
+
+	room = skb_tailroom(skb) - nla_total_size(0);
+	if (room < (int)sizeof(*dst))
+		goto cancel;
+	n = min_t(unsigned long, end - tail, room / sizeof(*dst));
+
+	na = nla_reserve(skb, TASKSTATS_RING_TYPE_ENTRIES, n * sizeof(*dst));
+	if (!na)
+		goto cancel;
+	dst = nla_data(na);
+
+	smp_rmb();
+	for (i = 0; i < n; i++)
+		dst[i] = ring->entries[(tail + i) & TASKSTATS_RING_MASK];
+	smp_rmb();
+
+	/* entries before first may have been rewritten during the copy */
+	head = ACCESS_ONCE(ring->head);
+	first = head - TASKSTATS_RING_ENTRIES + 1;
+	if ((long)(first - tail) > 0) {
+		genlmsg_cancel(skb, reply);
+		n = min_t(unsigned long, first - tail, end - tail);
+		ring->lost += n;
+		ring->tail = tail + n;
+		return n;
+	}
+
+	genlmsg_end(skb, reply);
+	ring->lost = 0;
+	ring->tail = tail + n;
+	return n;
+
+cancel:
+	genlmsg_cancel(skb, reply);
+	return -EMSGSIZE;
+}
+
+/*
+ * Dump callback for TASKSTATS_RING_CMD_GET.  cb->args[0] is the cpu
+ * being drained and cb->args[1] the head it is drained up to, sampled
+ * when the dump reaches the cpu so that a busy cpu cannot keep the dump
+ * going forever.  Dumps are serialized by the genetlink mutex, which
+ * makes the dump the only reader of the rings.
+ */
+int taskstats_ring_dump(struct sk_buff *skb, struct netlink_callback *cb,
+			struct genl_family *family)
+{
+	int cpu;
+
+	for (cpu = cb->args[0]; cpu < nr_cpu_ids; cpu++) {
+		struct taskstats_ring *ring = &per_cpu(taskstats_rings, cpu);
+		int ret;
+
+		if (!cpu_possible(cpu) || !ring->entries)
+			continue;
+
+		if (cpu != cb->args[0] || !cb->args[2]) {
+			cb->args[1] = ACCESS_ONCE(ring->head);
+			cb->args[2] = 1;
+		}
+
+		do {
+			ret = taskstats_ring_put(skb, cb, family, cpu,
+						 cb->args[1]);
+		} while (ret > 0);
+
+		if (ret < 0) {
+			cb->args[0] = cpu;
+			return skb->len;
+		}
+		cb->args[2] = 0;
+	}
+
+	cb->args[0] = cpu;
+	return skb->len;
+}
+
+#ifdef CONFIG_DEBUG_MICROBENCH
+/*
+ * /sys/kernel/debug/bench/taskstats_ring logs current into a scratch ring
+ * in batches with interrupts off, then times a ping-pong between current
+ * and a kthread on the same cpu, and reports the cost of an entry, the
+ * cost of a context switch (with the ring logging it) and the share of
+ * the switch that the entry takes.
+ */
+#define TASKSTATS_RING_BENCH_LOOPS	100000
+#define TASKSTATS_RING_BENCH_BATCH	1000
+#define TASKSTATS_RING_BENCH_SWITCHES	10000
+
+static DECLARE_COMPLETION(taskstats_ring_bench_ping);
+static DECLARE_COMPLETION(taskstats_ring_bench_pong);
+
+static int taskstats_ring_bench_pong_fn(void *unused)
+{
+	int i;
+
+	for (i = 0; i < TASKSTATS_RING_BENCH_SWITCHES; i++) {
+		wait_for_completion(&taskstats_ring_bench_ping);
+		complete(&taskstats_ring_bench_pong);
+	}
+	return 0;
+}
+
+/* Time TASKSTATS_RING_BENCH_SWITCHES round trips, two switches each */
+static int taskstats_ring_bench_switch(u64 *ns)
+{
+	cpumask_t allowed = current->cpus_allowed;
+	struct task_struct *tsk;
+	u64 start;
+	int cpu, i;
+
+	cpu = get_cpu();
+	put_cpu();
+	tsk = kthread_create(taskstats_ring_bench_pong_fn, NULL,
+			     "taskstats_bench");
+	if (IS_ERR(tsk))
+		return PTR_ERR(tsk);
+	kthread_bind(tsk, cpu);
+	set_cpus_allowed_ptr(current, cpumask_of(cpu));
+	INIT_COMPLETION(taskstats_ring_bench_ping);
+	INIT_COMPLETION(taskstats_ring_bench_pong);
+	wake_up_process(tsk);
+
+	start = sched_clock();
+	for (i = 0; i < TASKSTATS_RING_BENCH_SWITCHES; i++) {
+		complete(&taskstats_ring_bench_ping);
+		wait_for_completion(&taskstats_ring_bench_pong);
+	}
+	*ns = sched_clock() - start;
+
+	set_cpus_allowed_ptr(current, &allowed);
+	return 0;
+}
+
+static int taskstats_ring_bench_run(char *buf, size_t size)
+{
+	struct taskstats_ring ring = { };
+	u64 start, log_ns = 0, switch_ns = 0, pct;
+	int i, j, len, ret;
+
+	ring.entries = vmalloc(TASKSTATS_RING_ENTRIES * sizeof(*ring.entries));
+	if (!ring.entries)
+		return -ENOMEM;
+
+	for (i = 0; i < TASKSTATS_RING_BENCH_LOOPS;
+	     i += TASKSTATS_RING_BENCH_BATCH) {
+		local_irq_disable();
+		start = sched_clock();
+		for (j = 0; j < TASKSTATS_RING_BENCH_BATCH; j++)
+			taskstats_ring_log(&ring, current, start);
+		log_ns += sched_clock() - start;
+		local_irq_enable();
+		cond_resched();
+	}
+	vfree(ring.entries);
+
+	ret = taskstats_ring_bench_switch(&switch_ns);
+	if (ret)
+		return ret;
+
+	len = microbench_print(buf, size, "log", log_ns,
+			       TASKSTATS_RING_BENCH_LOOPS, "entry");
+	len += microbench_print(buf + len, size - len, "switch", switch_ns,
+				2 * TASKSTATS_RING_BENCH_SWITCHES, "switch");
+	/* entry cost over switch cost, in hundredths of a percent */
+	pct = div64_u64(log_ns * 2 * TASKSTATS_RING_BENCH_SWITCHES * 10000,
+			(u64)TASKSTATS_RING_BENCH_LOOPS * (switch_ns ? : 1));
+	len += scnprintf(buf + len, size - len, "overhead %llu.%02llu%%\n",
+			 (unsigned long long)pct / 100,
+			 (unsigned long long)pct % 100);
+	return len;
+}
+
+static struct microbench taskstats_ring_bench = {
+	.name	= "taskstats_ring",
+	.run	= taskstats_ring_bench_run,
+};
+
+static int __init taskstats_ring_bench_init(void)
+{
+	return microbench_register(&taskstats_ring_bench);
+}
+late_initcall(taskstats_ring_bench_init);
+#endif /* CONFIG_DEBUG_MICROBENCH */
+
+static int __init taskstats_ring_init(void)
+{
+	size_t size = TASKSTATS_RING_ENTRIES *
+		      sizeof(struct taskstats_ring_entry);
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct taskstats_ring *ring = &per_cpu(taskstats_rings, cpu);
+
+		ring->entries = alloc_pages_exact(size, GFP_KERNEL);
+		if (!ring->entries)
+			printk(KERN_WARNING "taskstats_ring: no ring for "
+			       "cpu %d\n", cpu);
+	}
+	return 0;
+}
+core_initcall(taskstats_ring_init);
@@ -2072,16 +2072,9 @@ static void rb_end_commit(struct ring_buffer_per_cpu *cpu_buffer)
 	}
 }
 
-static struct ring_buffer_event *
-rb_reserve_next_event(struct ring_buffer *buffer,
-		      struct ring_buffer_per_cpu *cpu_buffer,
-		      unsigned long length)
+static inline int rb_start_commit_check(struct ring_buffer *buffer,
+					struct ring_buffer_per_cpu *cpu_buffer)
 {
-	struct ring_buffer_event *event;
-	u64 ts, delta = 0;
-	int commit = 0;
-	int nr_loops = 0;
-
 	rb_start_commit(cpu_buffer);
 
 #ifdef CONFIG_RING_BUFFER_ALLOW_SWAP
@@ -2095,11 +2088,25 @@ rb_reserve_next_event(struct ring_buffer *buffer,
 	if (unlikely(ACCESS_ONCE(cpu_buffer->buffer) != buffer)) {
 		local_dec(&cpu_buffer->committing);
 		local_dec(&cpu_buffer->commits);
-		return NULL;
+		return -EBUSY;
 	}
 #endif
+	return 0;
+}
+
+/*
+ * Reserve an event of @length bytes, header included, with the commit
+ * already started.  Ends the commit on failure.
+ */
+static struct ring_buffer_event *
+__rb_reserve_next_event(struct ring_buffer_per_cpu *cpu_buffer,
+			unsigned long length)
+{
+	struct ring_buffer_event *event;
+	u64 ts, delta = 0;
+	int commit = 0;
+	int nr_loops = 0;
 
-	length = rb_calculate_event_length(length);
  again:
 	/*
 	 * We allow for interrupts to reenter here and do a trace.
@@ -2171,6 +2178,81 @@ rb_reserve_next_event(struct ring_buffer *buffer,
 	return NULL;
 }
 
+static struct ring_buffer_event *
+rb_reserve_next_event(struct ring_buffer *buffer,
+		      struct ring_buffer_per_cpu *cpu_buffer,
+		      unsigned long length)
+{
+	if (rb_start_commit_check(buffer, cpu_buffer))
+		return NULL;
+
+	length = rb_calculate_event_length(length);
+	return __rb_reserve_next_event(cpu_buffer, length);
+}
+
+/*
+ * Fast path for compact events.  When the writer is not nested in
+ * another write on this cpu, everything on the tail page is committed,
+ * the event fits behind it and the time delta fits in the event header,
+ * the event is claimed with a single cmpxchg on the tail page and is
+ * known to be the commit.  That skips the time extend, page move and
+ * commit ownership handling of __rb_reserve_next_event(), which the
+ * remaining cases fall back to.  @length is the data length.
+ */
+static __always_inline struct ring_buffer_event *
+rb_reserve_compact_event(struct ring_buffer *buffer,
+			 struct ring_buffer_per_cpu *cpu_buffer,
+			 unsigned long length)
+{
+	struct ring_buffer_event *event;
+	struct buffer_page *tail_page;
+	unsigned long write, tail;
+	u64 ts, delta;
+
+	/* compact events are small, so the length fits in type_len */
+	length = ALIGN(length + RB_EVNT_HDR_SIZE, RB_ALIGNMENT);
+
+	if (rb_start_commit_check(buffer, cpu_buffer))
+		return NULL;
+
+	if (local_read(&cpu_buffer->committing) != 1)
+		goto slow;
+
+	tail_page = cpu_buffer->tail_page;
+	if (tail_page != cpu_buffer->commit_page)
+		goto slow;
+
+	write = local_read(&tail_page->write);
+	tail = write & RB_WRITE_MASK;
+	/* the first event of a page also sets the page time stamp */
+	if (!tail || tail != rb_commit_index(cpu_buffer) ||
+	    tail + length > BUF_PAGE_SIZE)
+		goto slow;
+
+	ts = rb_time_stamp(buffer);
+	delta = ts - cpu_buffer->write_stamp;
+	barrier();
+	if (unlikely(ts < cpu_buffer->write_stamp || test_time_stamp(delta)))
+		goto slow;
+
+	/* an interrupt may have written to the page since it was read */
+	if (local_cmpxchg(&tail_page->write, write, write + length) != write)
+		goto slow;
+
+	event = __rb_page_index(tail_page, tail);
+	kmemcheck_annotate_bitfield(event, bitfield);
+	event->type_len = (length - RB_EVNT_HDR_SIZE) / RB_ALIGNMENT;
+	event->time_delta = delta;
+	local_inc(&tail_page->entries);
+
+	return event;
+
+ slow:
+	return __rb_reserve_next_event(cpu_buffer,
+				       rb_calculate_event_length(length -
+							RB_EVNT_HDR_SIZE));
+}
+
 #ifdef CONFIG_TRACING
 
 #define TRACE_RECURSIVE_DEPTH 16
@@ -2510,6 +2592,71 @@ int ring_buffer_write(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_write);
 
+/**
+ * ring_buffer_write_compact - write a small event with a 16 bit id
+ * @buffer: The ring buffer to write to.
+ * @id: The id of the event.
+ * @data: The payload of the event.
+ * @length: The length of the payload, at most RB_COMPACT_MAX_DATA.
+ *
+ * Compact events carry a 16 bit id followed by the payload, instead of
+ * a full struct trace_entry, and use the time delta in the event header
+ * as their only time stamp.  The event is reserved, filled and
+ * committed in one call without the recursion and resched bookkeeping
+ * of ring_buffer_lock_reserve(), and in the common case without its
+ * time extend and page move checks either (rb_reserve_compact_event()).
+ * Use ring_buffer_compact_id() and ring_buffer_compact_data() to read
+ * the event back.
+ */
+int ring_buffer_write_compact(struct ring_buffer *buffer, u16 id,
+			      const void *data, unsigned long length)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct ring_buffer_event *event;
+	u16 *body;
+	int ret = -EBUSY;
+	int cpu, resched;
+
+	if (unlikely(length > RB_COMPACT_MAX_DATA))
+		return -EINVAL;
+
+	if (ring_buffer_flags != RB_BUFFERS_ON)
+		return -EBUSY;
+
+	resched = ftrace_preempt_disable();
+
+	if (atomic_read(&buffer->record_disabled))
+		goto out;
+
+	cpu = raw_smp_processor_id();
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		goto out;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	if (atomic_read(&cpu_buffer->record_disabled))
+		goto out;
+
+	event = rb_reserve_compact_event(buffer, cpu_buffer,
+					 sizeof(*body) + length);
+	if (!event)
+		goto out;
+
+	body = rb_event_data(event);
+	*body = id;
+	memcpy(body + 1, data, length);
+
+	rb_commit(cpu_buffer, event);
+
+	ret = 0;
+ out:
+	ftrace_preempt_enable(resched);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_write_compact);
+
 static int rb_per_cpu_empty(struct ring_buffer_per_cpu *cpu_buffer)
 {
 	struct buffer_page *reader = cpu_buffer->reader_page;
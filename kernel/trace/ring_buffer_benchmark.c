@@ -5,6 +5,7 @@
  */
 #include <linux/ring_buffer.h>
 #include <linux/completion.h>
+#include <linux/hrtimer.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/time.h>
@@ -22,6 +23,9 @@ struct rb_page {
 /* number of events for writer to wake up the reader */
 static int wakeup_interval = 100;
 
+/* number of events written back to back by each timed burst */
+#define BURST_EVENTS	100000
+
 static int reader_finish;
 static struct completion read_start;
 static struct completion read_done;
@@ -187,6 +191,52 @@ static void ring_buffer_consumer(void)
 	complete(&read_done);
 }
 
+/*
+ * The hammer reads the clock for every event and races the reader, so
+ * its ns per entry mostly measures those.  Time a burst of back to back
+ * writes through the reserve/commit path, then through the compact
+ * path, and report the cost of one event of each.  Both events take 16
+ * bytes in the buffer.
+ */
+static void ring_buffer_time_bursts(void)
+{
+	struct ring_buffer_event *event;
+	unsigned long long ns;
+	ktime_t start;
+	u32 data[2];
+	int *entry;
+	int cpu;
+	int i;
+
+	preempt_disable();
+	cpu = smp_processor_id();
+	start = ktime_get();
+	for (i = 0; i < BURST_EVENTS; i++) {
+		event = ring_buffer_lock_reserve(buffer, 10);
+		if (event) {
+			entry = ring_buffer_event_data(event);
+			*entry = cpu;
+			ring_buffer_unlock_commit(buffer, event);
+		}
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	preempt_enable();
+	do_div(ns, BURST_EVENTS);
+	trace_printk("Reserve/commit: %lld ns per event\n", ns);
+
+	preempt_disable();
+	cpu = smp_processor_id();
+	data[0] = cpu;
+	data[1] = 0;
+	start = ktime_get();
+	for (i = 0; i < BURST_EVENTS; i++)
+		ring_buffer_write_compact(buffer, cpu, data, sizeof(data));
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	preempt_enable();
+	do_div(ns, BURST_EVENTS);
+	trace_printk("Compact write:  %lld ns per event\n", ns);
+}
+
 static void ring_buffer_producer(void)
 {
 	struct timeval start_tv;
@@ -307,6 +357,9 @@ static void ring_buffer_producer(void)
 		avg = NSEC_PER_MSEC / (hit + missed);
 		trace_printk("%ld ns per entry\n", avg);
 	}
+
+	if (!kill_test)
+		ring_buffer_time_bursts();
 }
 
 static void wait_to_die(void)
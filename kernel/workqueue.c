@@ -33,9 +33,76 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/hash.h>
+#include <linux/idr.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/workqueue.h>
 
+#include "workqueue_sched.h"
+
+/*
+ * Multithreaded workqueues which are neither freezeable nor rt don't
+ * own any threads.  Their per-CPU queues are served by a per-CPU pool
+ * of workers which is concurrency managed: the scheduler tells the
+ * pool when a busy worker blocks, and if there is still work pending
+ * an idle worker is woken to carry on.  One work item sleeping on I/O
+ * thus no longer holds up every other workqueue on that CPU, and the
+ * pool only grows as far as work actually blocks.
+ *
+ * A cpu_workqueue_struct is still drained by one task at a time, so
+ * the ordering, flush and cancel rules of a workqueue don't change.
+ * keventd is split into a few lanes per CPU, picked by hashing the
+ * work, so that its users don't all serialize behind each other.
+ *
+ * Every pooled workqueue but keventd has a rescuer thread.  If a pool
+ * stalls because no new worker can be created (typically under memory
+ * pressure) the rescuer runs the stalled queues of its workqueue, so
+ * users in the reclaim path keep their forward progress guarantee.
+ */
+enum {
+	CWQ_IDLE,		/* nothing queued, not on pool->queued */
+	CWQ_QUEUED,		/* on pool->queued waiting for a worker */
+	CWQ_RUNNING,		/* claimed by a worker or the rescuer */
+};
+
+#define MAX_IDLE_WORKERS	2	/* idle workers kept around */
+#define IDLE_WORKER_TIMEOUT	(300 * HZ)	/* then reap the rest */
+#define CREATE_COOLDOWN		HZ	/* retry after a failed create */
+#define MAYDAY_INITIAL_TIMEOUT	(HZ / 100 + 1)	/* stall before mayday */
+#define MAYDAY_INTERVAL		(HZ / 10 + 1)	/* and between maydays */
+#define KEVENTD_LANE_BITS	2
+
+struct worker;
+
+struct worker_pool {
+	spinlock_t lock;
+	int cpu;
+	struct list_head queued;	/* cwqs waiting for a worker */
+	struct list_head idle_list;	/* idle workers, most recent first */
+	struct list_head workers;	/* all started workers */
+	int nr_running;			/* busy workers not sleeping */
+	int nr_idle;
+	int managing;			/* a worker is creating another */
+	int dying;			/* cpu is down, don't start workers */
+	unsigned long next_create;	/* no creation before this */
+	struct worker *first;		/* created at CPU_UP_PREPARE */
+	struct timer_list mayday_timer;
+	struct ida worker_ida;
+};
+
+struct worker {
+	struct list_head entry;		/* on pool->idle_list */
+	struct list_head node;		/* on pool->workers */
+	struct worker_pool *pool;
+	struct task_struct *task;
+	struct cpu_workqueue_struct *cwq;	/* queue being run */
+	int id;
+	unsigned int busy:1;		/* counted in pool->nr_running... */
+	unsigned int sleeping:1;	/* ...unless this is set */
+};
+
+static DEFINE_PER_CPU(struct worker_pool, worker_pools);
+
 /*
  * The per-CPU workqueue (if single thread, we always use the first
  * possible cpu).
@@ -50,6 +117,12 @@ struct cpu_workqueue_struct {
 
 	struct workqueue_struct *wq;
 	struct task_struct *thread;
+
+	/* Pooled workqueues only, protected by pool->lock */
+	struct worker_pool *pool;
+	struct list_head pool_entry;
+	int pool_state;
+	struct task_struct *runner;	/* task running the queue */
 } ____cacheline_aligned;
 
 /*
@@ -63,6 +136,10 @@ struct workqueue_struct {
 	int singlethread;
 	int freezeable;		/* Freeze threads during suspend */
 	int rt;
+	int pooled;		/* Served by the per-CPU worker pools */
+	unsigned int lane_bits;	/* 1 << lane_bits cwqs per cpu */
+	struct task_struct *rescuer;
+	cpumask_var_t mayday_mask;	/* cpus asking the rescuer for help */
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
@@ -95,12 +172,27 @@ static const struct cpumask *wq_cpu_map(struct workqueue_struct *wq)
 		? cpu_singlethread_map : cpu_populated_map;
 }
 
-static
-struct cpu_workqueue_struct *wq_per_cpu(struct workqueue_struct *wq, int cpu)
+static inline int wq_nr_lanes(struct workqueue_struct *wq)
 {
+	return 1 << wq->lane_bits;
+}
+
+static inline struct cpu_workqueue_struct *
+wq_lane(struct workqueue_struct *wq, int cpu, int lane)
+{
+	return per_cpu_ptr(wq->cpu_wq, cpu) + lane;
+}
+
+static struct cpu_workqueue_struct *
+wq_per_cpu(struct workqueue_struct *wq, int cpu, struct work_struct *work)
+{
+	int lane = 0;
+
 	if (unlikely(is_wq_single_threaded(wq)))
 		cpu = singlethread_cpu;
-	return per_cpu_ptr(wq->cpu_wq, cpu);
+	if (wq->lane_bits)
+		lane = hash_ptr(work, wq->lane_bits);
+	return wq_lane(wq, cpu, lane);
 }
 
 /*
@@ -125,10 +217,48 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+/*
+ * Wake an idle worker to run the pool's queued cwqs.  If there is none
+ * left, somebody is either creating one or failed to, so arm the timer
+ * which calls the rescuers if the pool doesn't make progress.
+ *
+ * Called with pool->lock held.
+ */
+static void wake_up_worker(struct worker_pool *pool)
+{
+	if (!list_empty(&pool->idle_list)) {
+		struct worker *worker = list_first_entry(&pool->idle_list,
+							struct worker, entry);
+		wake_up_process(worker->task);
+	} else if (!timer_pending(&pool->mayday_timer)) {
+		mod_timer(&pool->mayday_timer,
+			  jiffies + MAYDAY_INITIAL_TIMEOUT);
+	}
+}
+
+/*
+ * Make sure somebody is going to run @cwq.  Called with cwq->lock
+ * held after work was added to its worklist.
+ */
+static void pool_queue_cwq(struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+
+	spin_lock(&pool->lock);
+	if (cwq->pool_state == CWQ_IDLE) {
+		cwq->pool_state = CWQ_QUEUED;
+		list_add_tail(&cwq->pool_entry, &pool->queued);
+		if (!pool->nr_running)
+			wake_up_worker(pool);
+	}
+	spin_unlock(&pool->lock);
+}
+
 static void insert_work(struct cpu_workqueue_struct *cwq,
 			struct work_struct *work, struct list_head *head)
 {
-	trace_workqueue_insertion(cwq->thread, work);
+	if (!cwq->pool)
+		trace_workqueue_insertion(cwq->thread, work);
 
 	set_wq_data(work, cwq);
 	/*
@@ -137,7 +267,10 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+	if (cwq->pool)
+		pool_queue_cwq(cwq);
+	else
+		wake_up(&cwq->more_work);
 }
 
 static void __queue_work(struct cpu_workqueue_struct *cwq,
@@ -189,7 +322,7 @@ queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work)
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work))) {
 		BUG_ON(!list_empty(&work->entry));
-		__queue_work(wq_per_cpu(wq, cpu), work);
+		__queue_work(wq_per_cpu(wq, cpu, work), work);
 		ret = 1;
 	}
 	return ret;
@@ -202,7 +335,8 @@ static void delayed_work_timer_fn(unsigned long __data)
 	struct cpu_workqueue_struct *cwq = get_wq_data(&dwork->work);
 	struct workqueue_struct *wq = cwq->wq;
 
-	__queue_work(wq_per_cpu(wq, smp_processor_id()), &dwork->work);
+	__queue_work(wq_per_cpu(wq, smp_processor_id(), &dwork->work),
+		     &dwork->work);
 }
 
 /**
@@ -246,7 +380,7 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		timer_stats_timer_set_start_info(&dwork->timer);
 
 		/* This stores cwq for the moment, for the timer_fn */
-		set_wq_data(work, wq_per_cpu(wq, raw_smp_processor_id()));
+		set_wq_data(work, wq_per_cpu(wq, raw_smp_processor_id(), work));
 		timer->expires = jiffies + delay;
 		timer->data = (unsigned long)dwork;
 		timer->function = delayed_work_timer_fn;
@@ -261,51 +395,59 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+/*
+ * Run the first work on @cwq->worklist.  Called and returns with
+ * cwq->lock held, drops it while the work runs.
+ */
+static void process_one_work(struct cpu_workqueue_struct *cwq)
 {
-	spin_lock_irq(&cwq->lock);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		work_func_t f = work->func;
+	struct work_struct *work = list_entry(cwq->worklist.next,
+					struct work_struct, entry);
+	work_func_t f = work->func;
 #ifdef CONFIG_LOCKDEP
-		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
-		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
 #endif
-		trace_workqueue_execution(cwq->thread, work);
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
-
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
-		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
-		lock_map_release(&cwq->wq->lockdep_map);
+	trace_workqueue_execution(current, work);
+	cwq->current_work = work;
+	list_del_init(cwq->worklist.next);
+	spin_unlock_irq(&cwq->lock);
 
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
-		}
+	BUG_ON(get_wq_data(work) != cwq);
+	work_clear_pending(work);
+	lock_map_acquire(&cwq->wq->lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	lock_map_release(&cwq->wq->lockdep_map);
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
 	}
+
+	spin_lock_irq(&cwq->lock);
+	cwq->current_work = NULL;
+}
+
+static void run_workqueue(struct cpu_workqueue_struct *cwq)
+{
+	spin_lock_irq(&cwq->lock);
+	while (!list_empty(&cwq->worklist))
+		process_one_work(cwq);
 	spin_unlock_irq(&cwq->lock);
 }
 
@@ -336,6 +478,354 @@ static int worker_thread(void *__cwq)
 	return 0;
 }
 
+/*
+ * Run up to @max works of a pooled @cwq which the caller has claimed
+ * off pool->queued, then hand it back to the pool: queued again at the
+ * tail if there is more to do, so that busy queues take turns.
+ */
+static void pool_run_cwq(struct cpu_workqueue_struct *cwq, int max)
+{
+	struct worker_pool *pool = cwq->pool;
+
+	cwq->runner = current;
+	spin_lock_irq(&cwq->lock);
+	while (!list_empty(&cwq->worklist) && max--)
+		process_one_work(cwq);
+	cwq->runner = NULL;
+
+	spin_lock(&pool->lock);
+	if (list_empty(&cwq->worklist)) {
+		cwq->pool_state = CWQ_IDLE;
+	} else {
+		cwq->pool_state = CWQ_QUEUED;
+		list_add_tail(&cwq->pool_entry, &pool->queued);
+		if (!pool->nr_running)
+			wake_up_worker(pool);
+	}
+	spin_unlock(&pool->lock);
+	spin_unlock_irq(&cwq->lock);
+}
+
+/* Take the first queued cwq, called with pool->lock held. */
+static struct cpu_workqueue_struct *pool_claim_cwq(struct worker_pool *pool)
+{
+	struct cpu_workqueue_struct *cwq;
+
+	cwq = list_first_entry(&pool->queued, struct cpu_workqueue_struct,
+			       pool_entry);
+	list_del_init(&cwq->pool_entry);
+	cwq->pool_state = CWQ_RUNNING;
+	return cwq;
+}
+
+static int pool_worker_thread(void *__worker);
+
+static struct worker *create_worker(struct worker_pool *pool)
+{
+	struct worker *worker;
+	struct task_struct *p;
+	int id, err;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+
+	INIT_LIST_HEAD(&worker->entry);
+	INIT_LIST_HEAD(&worker->node);
+	worker->pool = pool;
+
+	if (!ida_pre_get(&pool->worker_ida, GFP_KERNEL))
+		goto fail;
+	spin_lock_irq(&pool->lock);
+	err = ida_get_new(&pool->worker_ida, &id);
+	spin_unlock_irq(&pool->lock);
+	if (err)
+		goto fail;
+	worker->id = id;
+
+	p = kthread_create(pool_worker_thread, worker, "kworker/%d:%d",
+			   pool->cpu, id);
+	if (IS_ERR(p)) {
+		spin_lock_irq(&pool->lock);
+		ida_remove(&pool->worker_ida, id);
+		spin_unlock_irq(&pool->lock);
+		goto fail;
+	}
+	worker->task = p;
+
+	trace_workqueue_creation(p, pool->cpu);
+
+	return worker;
+fail:
+	kfree(worker);
+	return NULL;
+}
+
+/*
+ * Put a freshly created worker to use.  It starts out idle.  Called
+ * with pool->lock held, fails if the pool's cpu went down meanwhile.
+ */
+static int start_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	if (pool->dying)
+		return -ENODEV;
+
+	list_add_tail(&worker->node, &pool->workers);
+	list_add(&worker->entry, &pool->idle_list);
+	pool->nr_idle++;
+	wake_up_process(worker->task);
+	return 0;
+}
+
+/* Stop a worker which is no longer on pool->workers. */
+static void destroy_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	trace_workqueue_destruction(worker->task);
+	kthread_stop(worker->task);
+
+	spin_lock_irq(&pool->lock);
+	ida_remove(&pool->worker_ida, worker->id);
+	spin_unlock_irq(&pool->lock);
+	kfree(worker);
+}
+
+/*
+ * The pool ran out of idle workers, make a new one so that there is
+ * somebody to take over should the caller block.  Called with
+ * pool->lock held, which is dropped meanwhile.
+ */
+static void manage_workers(struct worker_pool *pool)
+{
+	struct worker *worker;
+
+	pool->managing = 1;
+	spin_unlock_irq(&pool->lock);
+
+	worker = create_worker(pool);
+
+	spin_lock_irq(&pool->lock);
+	pool->managing = 0;
+	if (worker && !start_worker(worker))
+		return;
+
+	pool->next_create = jiffies + CREATE_COOLDOWN;
+	if (!list_empty(&pool->queued) && !timer_pending(&pool->mayday_timer))
+		mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INITIAL_TIMEOUT);
+
+	if (worker) {
+		spin_unlock_irq(&pool->lock);
+		destroy_worker(worker);
+		spin_lock_irq(&pool->lock);
+	}
+}
+
+/*
+ * Only one worker of a pool runs work at a time.  It keeps going while
+ * it doesn't block; once it does, wq_worker_sleeping() wakes the next
+ * idle worker, and whoever finds itself running alongside another busy
+ * worker after finishing a work goes back to idle.
+ */
+static int pool_worker_thread(void *__worker)
+{
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
+	long timeout = IDLE_WORKER_TIMEOUT;
+	int reaped = 0;
+
+	/*
+	 * The first worker of a cpu is bound by its creator, the others
+	 * bind themselves.  This can only fail when the cpu is going
+	 * down, in which case we end up unbound like a worker which was
+	 * migrated off the dead cpu, until CPU_POST_DEAD stops us.
+	 */
+	if (!set_cpus_allowed_ptr(current, cpumask_of(pool->cpu)))
+		current->flags |= PF_THREAD_BOUND;
+	current->flags |= PF_WQ_WORKER;
+
+	spin_lock_irq(&pool->lock);
+	for (;;) {
+		/* We start out on, and come back from, the idle list. */
+		list_del_init(&worker->entry);
+		pool->nr_idle--;
+
+		if (kthread_should_stop())
+			break;
+
+		if (!timeout && !pool->dying &&
+		    pool->nr_idle >= MAX_IDLE_WORKERS &&
+		    list_empty(&pool->queued)) {
+			list_del_init(&worker->node);
+			ida_remove(&pool->worker_ida, worker->id);
+			reaped = 1;
+			break;
+		}
+
+		while (!list_empty(&pool->queued) &&
+		       pool->nr_running <= worker->busy) {
+			struct cpu_workqueue_struct *cwq;
+
+			if (!pool->nr_idle && !pool->managing &&
+			    time_after_eq(jiffies, pool->next_create)) {
+				manage_workers(pool);
+				continue;
+			}
+
+			cwq = pool_claim_cwq(pool);
+			if (!worker->busy) {
+				worker->busy = 1;
+				pool->nr_running++;
+			}
+			spin_unlock_irq(&pool->lock);
+
+			worker->cwq = cwq;
+			pool_run_cwq(cwq, 1);
+			worker->cwq = NULL;
+			cond_resched();
+
+			spin_lock_irq(&pool->lock);
+		}
+
+		if (worker->busy) {
+			worker->busy = 0;
+			pool->nr_running--;
+		}
+		list_add(&worker->entry, &pool->idle_list);
+		pool->nr_idle++;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock_irq(&pool->lock);
+		if (!kthread_should_stop())
+			timeout = schedule_timeout(IDLE_WORKER_TIMEOUT);
+		__set_current_state(TASK_RUNNING);
+		spin_lock_irq(&pool->lock);
+	}
+	current->flags &= ~PF_WQ_WORKER;
+	spin_unlock_irq(&pool->lock);
+
+	if (reaped) {
+		trace_workqueue_destruction(current);
+		kfree(worker);
+	}
+	return 0;
+}
+
+/**
+ * wq_worker_sleeping - a pool worker is going to sleep
+ * @task: the worker, always current
+ *
+ * Called from schedule() with preemption disabled.  If the worker was
+ * running work and other work is pending, wake up another worker.
+ */
+void wq_worker_sleeping(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+	struct worker_pool *pool = worker->pool;
+	unsigned long flags;
+
+	if (!worker->busy || worker->sleeping)
+		return;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	worker->sleeping = 1;
+	if (!--pool->nr_running && !list_empty(&pool->queued))
+		wake_up_worker(pool);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/**
+ * wq_worker_running - a pool worker is back on the cpu
+ * @task: the worker, always current
+ *
+ * Called at the end of schedule(), undoes wq_worker_sleeping().
+ */
+void wq_worker_running(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+	struct worker_pool *pool = worker->pool;
+	unsigned long flags;
+
+	if (!worker->sleeping)
+		return;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	worker->sleeping = 0;
+	pool->nr_running++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/*
+ * The pool has had work pending for a while without anybody to run
+ * it.  Ask the rescuers of the stalled workqueues to step in, and keep
+ * asking until the pool makes progress again.
+ */
+static void pool_mayday_timeout(unsigned long data)
+{
+	struct worker_pool *pool = (struct worker_pool *)data;
+	struct cpu_workqueue_struct *cwq;
+	int rearm = 0;
+
+	spin_lock_irq(&pool->lock);
+	if (!pool->nr_running && !pool->nr_idle) {
+		list_for_each_entry(cwq, &pool->queued, pool_entry) {
+			struct workqueue_struct *wq = cwq->wq;
+
+			if (!wq->rescuer)
+				continue;
+			cpumask_set_cpu(pool->cpu, wq->mayday_mask);
+			wake_up_process(wq->rescuer);
+			rearm = 1;
+		}
+	}
+	if (rearm)
+		mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INTERVAL);
+	spin_unlock_irq(&pool->lock);
+}
+
+static int rescuer_thread(void *__wq)
+{
+	struct workqueue_struct *wq = __wq;
+	int cpu;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (cpumask_empty(wq->mayday_mask)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		for_each_cpu(cpu, wq->mayday_mask) {
+			struct cpu_workqueue_struct *cwq = wq_lane(wq, cpu, 0);
+			struct worker_pool *pool = cwq->pool;
+
+			cpumask_clear_cpu(cpu, wq->mayday_mask);
+
+			/* The works expect to run on their cpu. */
+			set_cpus_allowed_ptr(current, cpumask_of(cpu));
+
+			spin_lock_irq(&pool->lock);
+			if (cwq->pool_state != CWQ_QUEUED) {
+				spin_unlock_irq(&pool->lock);
+				continue;
+			}
+			list_del_init(&cwq->pool_entry);
+			cwq->pool_state = CWQ_RUNNING;
+			spin_unlock_irq(&pool->lock);
+
+			pool_run_cwq(cwq, INT_MAX);
+		}
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
 struct wq_barrier {
 	struct work_struct	work;
 	struct completion	done;
@@ -363,7 +853,7 @@ static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 	int active = 0;
 	struct wq_barrier barr;
 
-	WARN_ON(cwq->thread == current);
+	WARN_ON(cwq->thread == current || cwq->runner == current);
 
 	spin_lock_irq(&cwq->lock);
 	if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
@@ -394,13 +884,14 @@ static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 void flush_workqueue(struct workqueue_struct *wq)
 {
 	const struct cpumask *cpu_map = wq_cpu_map(wq);
-	int cpu;
+	int cpu, lane;
 
 	might_sleep();
 	lock_map_acquire(&wq->lockdep_map);
 	lock_map_release(&wq->lockdep_map);
 	for_each_cpu(cpu, cpu_map)
-		flush_cpu_workqueue(per_cpu_ptr(wq->cpu_wq, cpu));
+		for (lane = 0; lane < wq_nr_lanes(wq); lane++)
+			flush_cpu_workqueue(wq_lane(wq, cpu, lane));
 }
 EXPORT_SYMBOL_GPL(flush_workqueue);
 
@@ -531,7 +1022,7 @@ static void wait_on_work(struct work_struct *work)
 	cpu_map = wq_cpu_map(wq);
 
 	for_each_cpu(cpu, cpu_map)
-		wait_on_cpu_work(per_cpu_ptr(wq->cpu_wq, cpu), work);
+		wait_on_cpu_work(wq_per_cpu(wq, cpu, work), work);
 }
 
 static int __cancel_work_timer(struct work_struct *work,
@@ -649,7 +1140,7 @@ void flush_delayed_work(struct delayed_work *dwork)
 {
 	if (del_timer_sync(&dwork->timer)) {
 		struct cpu_workqueue_struct *cwq;
-		cwq = wq_per_cpu(keventd_wq, get_cpu());
+		cwq = wq_per_cpu(keventd_wq, get_cpu(), &dwork->work);
 		__queue_work(cwq, &dwork->work);
 		put_cpu();
 	}
@@ -759,32 +1250,38 @@ int keventd_up(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = raw_smp_processor_id(); /* preempt-safe: keventd is per-cpu */
-	int ret = 0;
+	struct worker *worker;
 
 	BUG_ON(!keventd_wq);
 
-	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
-		ret = 1;
-
-	return ret;
+	if (!(current->flags & PF_WQ_WORKER))
+		return 0;
 
+	/* A worker is keventd while it runs one of the keventd lanes. */
+	worker = kthread_data(current);
+	return worker->cwq && worker->cwq->wq == keventd_wq;
 }
 EXPORT_SYMBOL_GPL(current_is_keventd);
 
 static struct cpu_workqueue_struct *
 init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
 {
-	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-
-	cwq->wq = wq;
-	spin_lock_init(&cwq->lock);
-	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
+	int lane;
+
+	for (lane = 0; lane < wq_nr_lanes(wq); lane++) {
+		struct cpu_workqueue_struct *cwq = wq_lane(wq, cpu, lane);
+
+		cwq->wq = wq;
+		spin_lock_init(&cwq->lock);
+		INIT_LIST_HEAD(&cwq->worklist);
+		init_waitqueue_head(&cwq->more_work);
+		INIT_LIST_HEAD(&cwq->pool_entry);
+		cwq->pool_state = CWQ_IDLE;
+		if (wq->pooled)
+			cwq->pool = &per_cpu(worker_pools, cpu);
+	}
 
-	return cwq;
+	return wq_lane(wq, cpu, 0);
 }
 
 static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
@@ -825,12 +1322,30 @@ static void start_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
 	}
 }
 
-struct workqueue_struct *__create_workqueue_key(const char *name,
-						int singlethread,
-						int freezeable,
-						int rt,
-						struct lock_class_key *key,
-						const char *lock_name)
+static int create_rescuer(struct workqueue_struct *wq)
+{
+	struct task_struct *p;
+
+	if (!zalloc_cpumask_var(&wq->mayday_mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	p = kthread_create(rescuer_thread, wq, "%s", wq->name);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+	wq->rescuer = p;
+	wake_up_process(p);
+
+	return 0;
+}
+
+static struct workqueue_struct *__alloc_workqueue(const char *name,
+						  int singlethread,
+						  int freezeable,
+						  int rt,
+						  unsigned int lane_bits,
+						  int rescuer,
+						  struct lock_class_key *key,
+						  const char *lock_name)
 {
 	struct workqueue_struct *wq;
 	struct cpu_workqueue_struct *cwq;
@@ -840,7 +1355,8 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	if (!wq)
 		return NULL;
 
-	wq->cpu_wq = alloc_percpu(struct cpu_workqueue_struct);
+	wq->cpu_wq = __alloc_percpu(sizeof(*cwq) << lane_bits,
+				    __alignof__(*cwq));
 	if (!wq->cpu_wq) {
 		kfree(wq);
 		return NULL;
@@ -851,6 +1367,8 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	wq->singlethread = singlethread;
 	wq->freezeable = freezeable;
 	wq->rt = rt;
+	wq->pooled = !singlethread && !freezeable && !rt;
+	wq->lane_bits = wq->pooled ? lane_bits : 0;
 	INIT_LIST_HEAD(&wq->list);
 
 	if (singlethread) {
@@ -876,12 +1394,15 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 		 */
 		for_each_possible_cpu(cpu) {
 			cwq = init_cpu_workqueue(wq, cpu);
-			if (err || !cpu_online(cpu))
+			if (err || !cpu_online(cpu) || wq->pooled)
 				continue;
 			err = create_workqueue_thread(cwq, cpu);
 			start_workqueue_thread(cwq, cpu);
 		}
 		cpu_maps_update_done();
+
+		if (!err && wq->pooled && rescuer)
+			err = create_rescuer(wq);
 	}
 
 	if (err) {
@@ -890,10 +1411,58 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	}
 	return wq;
 }
+
+struct workqueue_struct *__create_workqueue_key(const char *name,
+						int singlethread,
+						int freezeable,
+						int rt,
+						struct lock_class_key *key,
+						const char *lock_name)
+{
+	return __alloc_workqueue(name, singlethread, freezeable, rt, 0, 1,
+				 key, lock_name);
+}
 EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
+/*
+ * Wait until the pool is done with a flushed @cwq, so that it can be
+ * freed.  A queue which was emptied by cancel is still on pool->queued
+ * and is taken off here, the pool may be gone already.
+ */
+static void pool_retire_cwq(struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+	int idle;
+
+	for (;;) {
+		spin_lock_irq(&cwq->lock);
+		spin_lock(&pool->lock);
+		if (cwq->pool_state == CWQ_QUEUED &&
+		    list_empty(&cwq->worklist)) {
+			list_del_init(&cwq->pool_entry);
+			cwq->pool_state = CWQ_IDLE;
+		}
+		idle = cwq->pool_state == CWQ_IDLE;
+		spin_unlock(&pool->lock);
+		spin_unlock_irq(&cwq->lock);
+
+		if (idle)
+			break;
+		schedule_timeout_uninterruptible(1);
+	}
+}
+
 static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 {
+	if (cwq->pool) {
+		lock_map_acquire(&cwq->wq->lockdep_map);
+		lock_map_release(&cwq->wq->lockdep_map);
+
+		flush_cpu_workqueue(cwq);
+		pool_retire_cwq(cwq);
+		return;
+	}
+
 	/*
 	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
 	 * cpu_add_remove_lock protects cwq->thread.
@@ -929,7 +1498,7 @@ static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	const struct cpumask *cpu_map = wq_cpu_map(wq);
-	int cpu;
+	int cpu, lane;
 
 	cpu_maps_update_begin();
 	spin_lock(&workqueue_lock);
@@ -937,33 +1506,79 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	spin_unlock(&workqueue_lock);
 
 	for_each_cpu(cpu, cpu_map)
-		cleanup_workqueue_thread(per_cpu_ptr(wq->cpu_wq, cpu));
+		for (lane = 0; lane < wq_nr_lanes(wq); lane++)
+			cleanup_workqueue_thread(wq_lane(wq, cpu, lane));
  	cpu_maps_update_done();
 
+	if (wq->rescuer)
+		kthread_stop(wq->rescuer);
+	free_cpumask_var(wq->mayday_mask);
 	free_percpu(wq->cpu_wq);
 	kfree(wq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
+/*
+ * Stop all workers of a pool whose cpu went down, or never came up.
+ * Its queues have been flushed by now.
+ */
+static void destroy_worker_pool(struct worker_pool *pool)
+{
+	struct worker *worker, *tmp;
+	LIST_HEAD(workers);
+
+	spin_lock_irq(&pool->lock);
+	pool->dying = 1;
+	list_splice_init(&pool->workers, &workers);
+	spin_unlock_irq(&pool->lock);
+
+	if (pool->first) {
+		destroy_worker(pool->first);
+		pool->first = NULL;
+	}
+	list_for_each_entry_safe(worker, tmp, &workers, node)
+		destroy_worker(worker);
+
+	del_timer_sync(&pool->mayday_timer);
+}
+
 static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						unsigned long action,
 						void *hcpu)
 {
 	unsigned int cpu = (unsigned long)hcpu;
+	struct worker_pool *pool = &per_cpu(worker_pools, cpu);
 	struct cpu_workqueue_struct *cwq;
 	struct workqueue_struct *wq;
 	int ret = NOTIFY_OK;
+	int lane;
 
 	action &= ~CPU_TASKS_FROZEN;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
 		cpumask_set_cpu(cpu, cpu_populated_map);
+		pool->dying = 0;
+		pool->first = create_worker(pool);
+		if (pool->first)
+			break;
+		printk(KERN_ERR "workqueue pool for %i failed\n", cpu);
+		action = CPU_UP_CANCELED;
+		ret = NOTIFY_BAD;
 	}
 undo:
 	list_for_each_entry(wq, &workqueues, list) {
 		cwq = per_cpu_ptr(wq->cpu_wq, cpu);
 
+		if (wq->pooled) {
+			if (action == CPU_UP_CANCELED ||
+			    action == CPU_POST_DEAD)
+				for (lane = 0; lane < wq_nr_lanes(wq); lane++)
+					cleanup_workqueue_thread(
+						wq_lane(wq, cpu, lane));
+			continue;
+		}
+
 		switch (action) {
 		case CPU_UP_PREPARE:
 			if (!create_workqueue_thread(cwq, cpu))
@@ -987,8 +1602,17 @@ undo:
 	}
 
 	switch (action) {
+	case CPU_ONLINE:
+		kthread_bind(pool->first->task, cpu);
+		spin_lock_irq(&pool->lock);
+		start_worker(pool->first);
+		spin_unlock_irq(&pool->lock);
+		pool->first = NULL;
+		break;
+
 	case CPU_UP_CANCELED:
 	case CPU_POST_DEAD:
+		destroy_worker_pool(pool);
 		cpumask_clear_cpu(cpu, cpu_populated_map);
 	}
 
@@ -1044,12 +1668,43 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
 
 void __init init_workqueues(void)
 {
+	static struct lock_class_key keventd_key;
+	int cpu;
+
 	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
 
 	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
+
+	for_each_possible_cpu(cpu) {
+		struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+
+		spin_lock_init(&pool->lock);
+		pool->cpu = cpu;
+		INIT_LIST_HEAD(&pool->queued);
+		INIT_LIST_HEAD(&pool->idle_list);
+		INIT_LIST_HEAD(&pool->workers);
+		pool->dying = !cpu_online(cpu);
+		pool->next_create = jiffies;
+		setup_timer(&pool->mayday_timer, pool_mayday_timeout,
+			    (unsigned long)pool);
+		ida_init(&pool->worker_ida);
+	}
+
+	for_each_online_cpu(cpu) {
+		struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+		struct worker *worker = create_worker(pool);
+
+		BUG_ON(!worker);
+		kthread_bind(worker->task, cpu);
+		spin_lock_irq(&pool->lock);
+		start_worker(worker);
+		spin_unlock_irq(&pool->lock);
+	}
+
 	hotcpu_notifier(workqueue_cpu_callback, 0);
-	keventd_wq = create_workqueue("events");
+	keventd_wq = __alloc_workqueue("events", 0, 0, 0, KEVENTD_LANE_BITS,
+				       0, &keventd_key, "events");
 	BUG_ON(!keventd_wq);
 }
@@ -0,0 +1,8 @@
+/*
+ * kernel/workqueue_sched.h
+ *
+ * Scheduler hooks for concurrency managed workqueue.  Only to be
+ * included from sched.c and workqueue.c.
+ */
+void wq_worker_sleeping(struct task_struct *task);
+void wq_worker_running(struct task_struct *task);
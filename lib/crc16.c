@@ -6,6 +6,7 @@
  */
 
 #include <linux/types.h>
+#include <linux/init.h>
 #include <linux/module.h>
 #include <linux/crc16.h>
 
@@ -46,6 +47,22 @@ u16 const crc16_table[256] = {
 };
 EXPORT_SYMBOL(crc16_table);
 
+/*
+ * Tables to run four bytes at a time, crc16_slice[k][i] is the crc of
+ * byte i followed by k + 1 zero bytes.  They are built from crc16_table
+ * before any user of crc16 can run; until then crc16() goes a byte at
+ * a time.
+ */
+static u16 crc16_slice[3][256] __read_mostly;
+static int crc16_sliced __read_mostly;
+
+static inline u16 crc16_word(u16 crc, u8 const *p)
+{
+	crc ^= p[0] | (p[1] << 8);
+	return crc16_slice[2][crc & 0xff] ^ crc16_slice[1][crc >> 8] ^
+	       crc16_slice[0][p[2]] ^ crc16_table[p[3]];
+}
+
 /**
  * crc16 - compute the CRC-16 for the data buffer
  * @crc:	previous CRC value
@@ -56,12 +73,34 @@ EXPORT_SYMBOL(crc16_table);
  */
 u16 crc16(u16 crc, u8 const *buffer, size_t len)
 {
+	if (crc16_sliced) {
+		for (; len >= 4; len -= 4, buffer += 4)
+			crc = crc16_word(crc, buffer);
+	}
 	while (len--)
 		crc = crc16_byte(crc, *buffer++);
 	return crc;
 }
 EXPORT_SYMBOL(crc16);
 
+static int __init crc16_init(void)
+{
+	int i, k;
+	u16 crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = crc16_table[i];
+		for (k = 0; k < 3; k++) {
+			crc = crc16_byte(crc, 0);
+			crc16_slice[k][i] = crc;
+		}
+	}
+	smp_wmb();
+	crc16_sliced = 1;
+	return 0;
+}
+core_initcall(crc16_init);
+
 MODULE_DESCRIPTION("CRC16 calculations");
 MODULE_LICENSE("GPL");
 
@@ -989,6 +989,7 @@ static struct crc_test {
 	 0x9dc0bb48},
 };
 
+#include <linux/math64.h>
 #include <linux/time.h>
 
 static int __init crc32c_test(void)
@@ -1006,7 +1007,7 @@ static int __init crc32c_test(void)
 
 	/* pre-warm the cache */
 	for (i = 0; i < 100; i++) {
-		bytes += 2*test[i].length;
+		bytes += test[i].length;
 
 		crc ^= __crc32c_le(test[i].crc, test_buf +
 		    test[i].start, test[i].length);
@@ -1033,10 +1034,10 @@ static int __init crc32c_test(void)
 	pr_info("crc32c: CRC_LE_BITS = %d\n", CRC_LE_BITS);
 
 	if (errors)
-		pr_warn("crc32c: %d self tests failed\n", errors);
+		pr_warning("crc32c: %d self tests failed\n", errors);
 	else {
-		pr_info("crc32c: self tests passed, processed %d bytes in %lld nsec\n",
-			bytes, nsec);
+		pr_info("crc32c: self tests passed, processed %d bytes in %lld nsec (%llu MB/s)\n",
+			bytes, nsec, div64_u64((u64)bytes * 1000, nsec ?: 1));
 	}
 
 	return 0;
@@ -1092,10 +1093,10 @@ static int __init crc32_test(void)
 		 CRC_LE_BITS, CRC_BE_BITS);
 
 	if (errors)
-		pr_warn("crc32: %d self tests failed\n", errors);
+		pr_warning("crc32: %d self tests failed\n", errors);
 	else {
-		pr_info("crc32: self tests passed, processed %d bytes in %lld nsec\n",
-			bytes, nsec);
+		pr_info("crc32: self tests passed, processed %d bytes in %lld nsec (%llu MB/s)\n",
+			bytes, nsec, div64_u64((u64)bytes * 1000, nsec ?: 1));
 	}
 
 	return 0;
@@ -32,11 +32,25 @@
  */
 
 #include <crypto/hash.h>
+#include <linux/crc32.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 
+#if !defined(CONFIG_CRYPTO_CRC32C_INTEL) && \
+    !defined(CONFIG_CRYPTO_CRC32C_INTEL_MODULE)
+/*
+ * Without a hardware crc32c driver the crypto API would end up in the
+ * slice-by-8 __crc32c_le() of lib/crc32.c anyway, so call it directly
+ * and save the shash indirection on every call.
+ */
+u32 crc32c(u32 crc, const void *address, unsigned int length)
+{
+	return __crc32c_le(crc, address, length);
+}
+EXPORT_SYMBOL(crc32c);
+#else
 static struct crypto_shash *tfm;
 
 u32 crc32c(u32 crc, const void *address, unsigned int length)
@@ -75,6 +89,7 @@ static void __exit libcrc32c_mod_fini(void)
 
 module_init(libcrc32c_mod_init);
 module_exit(libcrc32c_mod_fini);
+#endif
 
 MODULE_AUTHOR("Clay Haapala <chaapala@cisco.com>");
 MODULE_DESCRIPTION("CRC32c (Castagnoli) calculations");
@@ -40,14 +40,15 @@ lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
 		u32 dv;
 literal:
 		ip += 1 + ((ip - ii) >> 5);
+		LZO_PREFETCH(ip + 64);
 next:
 		if (unlikely(ip >= ip_end))
 			break;
-		dv = get_unaligned_le32(ip);
+		dv = LOAD_LE32(ip);
 		t = ((dv * 0x1824429d) >> (32 - D_BITS)) & D_MASK;
 		m_pos = in + dict[t];
 		dict[t] = (lzo_dict_t) (ip - in);
-		if (unlikely(dv != get_unaligned_le32(m_pos)))
+		if (unlikely(dv != LOAD_LE32(m_pos)))
 			goto literal;
 
 		ii -= ti;
@@ -112,13 +113,11 @@ next:
 #  endif
 #elif defined(LZO_USE_CTZ32)
 		u32 v;
-		v = get_unaligned((const u32 *) (ip + m_len)) ^
-		    get_unaligned((const u32 *) (m_pos + m_len));
+		v = LOAD32(ip + m_len) ^ LOAD32(m_pos + m_len);
 		if (unlikely(v == 0)) {
 			do {
 				m_len += 4;
-				v = get_unaligned((const u32 *) (ip + m_len)) ^
-				    get_unaligned((const u32 *) (m_pos + m_len));
+				v = LOAD32(ip + m_len) ^ LOAD32(m_pos + m_len);
 				if (unlikely(ip + m_len >= ip_end))
 					goto m_len_done;
 			} while (v == 0);
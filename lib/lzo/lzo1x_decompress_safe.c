@@ -68,6 +68,7 @@ copy_literal_run:
 					const unsigned char *ie = ip + t;
 					unsigned char *oe = op + t;
 					do {
+						LZO_PREFETCH(ip + 64);
 						COPY8(op, ip);
 						op += 8;
 						ip += 8;
@@ -176,13 +177,27 @@ copy_literal_run:
 		} else {
 			unsigned char *oe = op + t;
 			NEED_OP(t);
-			op[0] = m_pos[0];
-			op[1] = m_pos[1];
-			op += 2;
-			m_pos += 2;
-			do {
-				*op++ = *m_pos++;
-			} while (op < oe);
+			if (op - m_pos == 1) {
+				/* a run of one byte */
+				memset(op, *m_pos, t);
+				op = oe;
+			} else if (op - m_pos >= 4 && HAVE_OP(t + 3)) {
+				/* each word read was written before */
+				do {
+					COPY4(op, m_pos);
+					op += 4;
+					m_pos += 4;
+				} while (op < oe);
+				op = oe;
+			} else {
+				op[0] = m_pos[0];
+				op[1] = m_pos[1];
+				op += 2;
+				m_pos += 2;
+				do {
+					*op++ = *m_pos++;
+				} while (op < oe);
+			}
 		}
 match_next:
 		state = next;
@@ -0,0 +1,184 @@
+/*
+ *  LZO1X self test and throughput benchmark
+ *
+ *  Compresses a few generated 4KB buffers, checks that the output is
+ *  the same as that of the reference implementation and that it
+ *  decompresses back to the input, then reports the throughput of the
+ *  compressor and the decompressor over the same buffers.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/crc32.h>
+#include <linux/lzo.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#define LZO_TEST_LEN		4096
+#define LZO_TEST_LOOPS		256
+
+enum {
+	LZO_TEST_ZERO,		/* a zero page */
+	LZO_TEST_TEXT,		/* words of a small vocabulary */
+	LZO_TEST_RANDOM,	/* incompressible */
+	LZO_TEST_ANON,		/* runs of zeroes between small words */
+	LZO_TEST_NR
+};
+
+/* Length and crc32_le(~0, ...) of the reference compressor's output */
+#define LZO_TEST_ZERO_LEN	44
+#define LZO_TEST_ZERO_CRC	0x951105b9
+#define LZO_TEST_TEXT_LEN	1530
+#define LZO_TEST_TEXT_CRC	0x5781470a
+#define LZO_TEST_RANDOM_LEN	4116
+#define LZO_TEST_RANDOM_CRC	0x11587fa0
+#define LZO_TEST_ANON_LEN	1398
+#define LZO_TEST_ANON_CRC	0x148f2c8a
+
+static const struct {
+	const char *name;
+	size_t len;
+	u32 crc;
+} lzo_test_ref[LZO_TEST_NR] = {
+	[LZO_TEST_ZERO]		= { "zero",	LZO_TEST_ZERO_LEN,
+					LZO_TEST_ZERO_CRC },
+	[LZO_TEST_TEXT]		= { "text",	LZO_TEST_TEXT_LEN,
+					LZO_TEST_TEXT_CRC },
+	[LZO_TEST_RANDOM]	= { "random",	LZO_TEST_RANDOM_LEN,
+					LZO_TEST_RANDOM_CRC },
+	[LZO_TEST_ANON]		= { "anon",	LZO_TEST_ANON_LEN,
+					LZO_TEST_ANON_CRC },
+};
+
+static const char * const lzo_test_words[] = {
+	"the", "page", "cache", "of", "a", "file", "is", "read", "ahead",
+	"when", "kernel", "memory", "swap", "zram", "compressed", "and",
+};
+
+static u32 __init lzo_test_rand(u32 *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 16;
+}
+
+static void __init lzo_test_fill(unsigned char *buf, int type)
+{
+	u32 state = type + 1;
+	size_t i = 0, n;
+	const char *w;
+
+	switch (type) {
+	case LZO_TEST_ZERO:
+		memset(buf, 0, LZO_TEST_LEN);
+		break;
+	case LZO_TEST_TEXT:
+		while (i < LZO_TEST_LEN) {
+			w = lzo_test_words[lzo_test_rand(&state) %
+					   ARRAY_SIZE(lzo_test_words)];
+			while (*w && i < LZO_TEST_LEN)
+				buf[i++] = *w++;
+			if (i < LZO_TEST_LEN)
+				buf[i++] = ' ';
+		}
+		break;
+	case LZO_TEST_RANDOM:
+		for (i = 0; i < LZO_TEST_LEN; i++)
+			buf[i] = lzo_test_rand(&state);
+		break;
+	case LZO_TEST_ANON:
+		while (i < LZO_TEST_LEN) {
+			n = 1 + lzo_test_rand(&state) % 64;
+			while (n-- && i < LZO_TEST_LEN)
+				buf[i++] = 0;
+			n = 4 * (1 + lzo_test_rand(&state) % 8);
+			while (n-- && i < LZO_TEST_LEN)
+				buf[i++] = n & 3 ? 0 : lzo_test_rand(&state);
+		}
+		break;
+	}
+}
+
+static int __init lzo1x_selftest(void)
+{
+	unsigned char *in, *out, *back;
+	void *wrkmem;
+	size_t len, back_len, total = 0;
+	u64 start, comp_ns = 0, decomp_ns = 0;
+	int type, i, ret, failed = 0;
+
+	in = vmalloc(LZO_TEST_NR * LZO_TEST_LEN);
+	out = vmalloc(LZO_TEST_NR * lzo1x_worst_compress(LZO_TEST_LEN));
+	back = vmalloc(LZO_TEST_LEN);
+	wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	if (!in || !out || !back || !wrkmem) {
+		printk(KERN_ERR "lzo1x: no memory for self test\n");
+		goto out;
+	}
+
+	for (type = 0; type < LZO_TEST_NR; type++) {
+		unsigned char *src = in + type * LZO_TEST_LEN;
+		unsigned char *dst = out +
+				     type * lzo1x_worst_compress(LZO_TEST_LEN);
+
+		lzo_test_fill(src, type);
+		ret = lzo1x_1_compress(src, LZO_TEST_LEN, dst, &len, wrkmem);
+		if (ret != LZO_E_OK || len != lzo_test_ref[type].len ||
+		    crc32_le(~0, dst, len) != lzo_test_ref[type].crc) {
+			printk(KERN_ERR "lzo1x: %s: compressed to %zu bytes, "
+			       "crc %08x, expected %zu bytes, crc %08x\n",
+			       lzo_test_ref[type].name, len,
+			       crc32_le(~0, dst, len), lzo_test_ref[type].len,
+			       lzo_test_ref[type].crc);
+			failed++;
+			continue;
+		}
+
+		back_len = LZO_TEST_LEN;
+		ret = lzo1x_decompress_safe(dst, len, back, &back_len);
+		if (ret != LZO_E_OK || back_len != LZO_TEST_LEN ||
+		    memcmp(back, src, LZO_TEST_LEN)) {
+			printk(KERN_ERR "lzo1x: %s: decompression failed (%d)\n",
+			       lzo_test_ref[type].name, ret);
+			failed++;
+		}
+	}
+	if (failed)
+		goto out;
+
+	for (i = 0; i < LZO_TEST_LOOPS; i++) {
+		for (type = 0; type < LZO_TEST_NR; type++) {
+			unsigned char *src = in + type * LZO_TEST_LEN;
+			unsigned char *dst = out + type *
+				lzo1x_worst_compress(LZO_TEST_LEN);
+
+			start = sched_clock();
+			lzo1x_1_compress(src, LZO_TEST_LEN, dst, &len, wrkmem);
+			comp_ns += sched_clock() - start;
+
+			back_len = LZO_TEST_LEN;
+			start = sched_clock();
+			lzo1x_decompress_safe(dst, len, back, &back_len);
+			decomp_ns += sched_clock() - start;
+		}
+		total += LZO_TEST_NR * LZO_TEST_LEN;
+		cond_resched();
+	}
+
+	/* bytes per ns * 1000 is MB/s */
+	printk(KERN_INFO "lzo1x: self test passed, compress %llu MB/s, "
+	       "decompress %llu MB/s\n",
+	       (unsigned long long)div64_u64((u64)total * 1000,
+					     comp_ns ? comp_ns : 1),
+	       (unsigned long long)div64_u64((u64)total * 1000,
+					     decomp_ns ? decomp_ns : 1));
+out:
+	vfree(wrkmem);
+	vfree(back);
+	vfree(out);
+	vfree(in);
+	return 0;
+}
+late_initcall(lzo1x_selftest);
@@ -11,9 +11,43 @@
  *  Richard Purdie <rpurdie@openedhand.com>
  */
 
+#if defined(CONFIG_ARM) && __LINUX_ARM_ARCH__ >= 6 && \
+	defined(__LITTLE_ENDIAN) && !defined(STATIC)
+/*
+ * ARMv6 and later do unaligned ldr and str in hardware once
+ * alignment_init() has cleared the A bit, where get_unaligned() is
+ * four byte loads.  ldrd and ldm still fault on unaligned addresses,
+ * so the accesses are kept as single word instructions in asm that
+ * the compiler cannot merge.  The pre-boot decompressor (STATIC) may
+ * run with the A bit set and keeps the generic accessors.
+ */
+#include <linux/prefetch.h>
+
+static inline u32 lzo_load32(const void *p)
+{
+	u32 v;
+
+	asm("ldr	%0, %1" : "=r" (v) : "m" (*(const u32 *)p));
+	return v;
+}
 
+static inline void lzo_store32(void *p, u32 v)
+{
+	asm("str	%1, %0" : "=m" (*(u32 *)p) : "r" (v));
+}
+
+#define LOAD32(p)		lzo_load32(p)
+#define LOAD_LE32(p)		lzo_load32(p)
+#define COPY4(dst, src)		lzo_store32((dst), lzo_load32(src))
+#define LZO_PREFETCH(p)		prefetch(p)
+#else
+#define LOAD32(p)		get_unaligned((const u32 *)(p))
+#define LOAD_LE32(p)		get_unaligned_le32(p)
 #define COPY4(dst, src)	\
 		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+#define LZO_PREFETCH(p)		do { } while (0)
+#endif
+
 #if defined(__x86_64__)
 #define COPY8(dst, src)	\
 		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
@@ -0,0 +1,98 @@
+/*
+ * Microbenchmarks in debugfs
+ *
+ * Each registered benchmark gets a file in /sys/kernel/debug/bench that
+ * runs it when read, so that kernels and configurations can be compared
+ * on the target without carrying timing code in the fast paths.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/microbench.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#define MICROBENCH_BUF	256
+
+static struct dentry *microbench_dir;
+static DEFINE_MUTEX(microbench_mutex);	/* one benchmark at a time */
+
+/**
+ * microbench_print - append a result line to a benchmark's output
+ * @buf:	output buffer
+ * @size:	space left in @buf
+ * @label:	what was timed
+ * @ns:		total time taken
+ * @loops:	number of operations timed
+ * @unit:	what one operation is, e.g. "page"
+ *
+ * Formats "<label> <ns per operation> ns/<unit>" with two decimals and
+ * returns the number of characters written.
+ */
+int microbench_print(char *buf, size_t size, const char *label, u64 ns,
+		     unsigned long loops, const char *unit)
+{
+	ns = div_u64(ns * 100, loops ? loops : 1);
+	return scnprintf(buf, size, "%s %llu.%02llu ns/%s\n", label,
+			 (unsigned long long)ns / 100,
+			 (unsigned long long)ns % 100, unit);
+}
+
+static ssize_t microbench_read(struct file *file, char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct microbench *mb = file->private_data;
+	char *buf;
+	ssize_t ret;
+	int len;
+
+	if (*ppos)
+		return 0;
+
+	buf = kmalloc(MICROBENCH_BUF, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	mutex_lock(&microbench_mutex);
+	len = mb->run(buf, MICROBENCH_BUF);
+	mutex_unlock(&microbench_mutex);
+	if (len < 0)
+		ret = len;
+	else
+		ret = simple_read_from_buffer(ubuf, count, ppos, buf, len);
+	kfree(buf);
+	return ret;
+}
+
+static int microbench_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations microbench_fops = {
+	.open		= microbench_open,
+	.read		= microbench_read,
+};
+
+/**
+ * microbench_register - add a benchmark to /sys/kernel/debug/bench
+ * @mb:		the benchmark, which must stay around
+ *
+ * To be called from an initcall no earlier than fs_initcall.
+ */
+int microbench_register(struct microbench *mb)
+{
+	if (!microbench_dir) {
+		microbench_dir = debugfs_create_dir("bench", NULL);
+		if (!microbench_dir)
+			return -ENOMEM;
+	}
+	if (!debugfs_create_file(mb->name, S_IRUSR, microbench_dir, mb,
+				 &microbench_fops))
+		return -ENOMEM;
+	return 0;
+}
@@ -110,16 +110,37 @@
  *    ->i_mmap_lock
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	void **slot;
+
+	if (!shadow) {
+		radix_tree_delete(&mapping->page_tree, page->index);
+		return;
+	}
+
+	/*
+	 * The page is clean and not under writeback, so the slot has no
+	 * tags for the shadow entry to inherit.
+	 */
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	radix_tree_replace_slot(slot, shadow);
+	mapping->nrshadows++;
+	workingset_shadow_added(mapping);
+}
+
 /*
  * Remove a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.  The caller must hold the mapping's tree_lock.
+ * is safe.  The caller must hold the mapping's tree_lock.  If @shadow is
+ * not NULL, it is left in the page's slot, see mm/workingset.c.
  */
-void __remove_from_page_cache(struct page *page)
+void __remove_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -147,7 +168,7 @@ void remove_from_page_cache(struct page *page)
 	BUG_ON(!PageLocked(page));
 
 	spin_lock_irq(&mapping->tree_lock);
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 }
@@ -405,17 +426,44 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 EXPORT_SYMBOL(filemap_write_and_wait_range);
 
 /**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
+ * page_cache_tree_insert - insert a page into a mapping's radix tree
+ * @mapping:	the address_space
+ * @index:	where to insert @page
+ * @page:	the page
+ * @shadowp:	where to return a replaced shadow entry, or NULL
+ *
+ * Inserts @page at @index, replacing the shadow entry of an evicted page
+ * there if there is one, see mm/workingset.c.  Returns -EEXIST if there
+ * is a page at @index already.  Everything that puts pages into
+ * @mapping->page_tree must go through here rather than calling
+ * radix_tree_insert() directly.  The caller must hold the mapping's
+ * tree_lock and have preloaded the radix tree.
  */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+int page_cache_tree_insert(struct address_space *mapping, pgoff_t index,
+			   struct page *page, void **shadowp)
+{
+	void **slot;
+	void *p;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, index);
+	if (slot) {
+		p = radix_tree_deref_slot(slot);
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		radix_tree_replace_slot(slot, page);
+		mapping->nrshadows--;
+		workingset_shadow_removed(mapping);
+		if (shadowp)
+			*shadowp = p;
+		return 0;
+	}
+	return radix_tree_insert(&mapping->page_tree, index, page);
+}
+EXPORT_SYMBOL(page_cache_tree_insert);
+
+static int __add_to_page_cache_locked(struct page *page,
+		struct address_space *mapping, pgoff_t offset, gfp_t gfp_mask,
+		void **shadowp)
 {
 	int error;
 
@@ -433,7 +481,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, offset, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -452,11 +500,28 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset, gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -468,14 +533,23 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset, gfp_mask,
+					 &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
-	return ret;
+
+	if (!page_is_file_cache(page))
+		lru_cache_add_anon(page);
+	else if (shadow && workingset_refault(shadow)) {
+		/* thrashing: start it out on the active list */
+		lru_cache_add_lru(page, LRU_ACTIVE_FILE);
+		workingset_activation(page);
+	} else
+		lru_cache_add_file(page);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
@@ -626,6 +700,64 @@ void __lock_page_nosync(struct page *page)
 							TASK_UNINTERRUPTIBLE);
 }
 
+/**
+ * page_cache_next_hole - find the next hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_next_hole() on @mapping->page_tree, except that the
+ * shadow entries of evicted pages count as holes.
+ */
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index++;
+		if (index == 0)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_next_hole);
+
+/**
+ * page_cache_prev_hole - find the prev hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_prev_hole() on @mapping->page_tree, except that the
+ * shadow entries of evicted pages count as holes.
+ */
+pgoff_t page_cache_prev_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index--;
+		if (index == ULONG_MAX)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_prev_hole);
+
 /**
  * find_get_page - find and get a page reference
  * @mapping: the address_space to search
@@ -647,6 +779,11 @@ repeat:
 		page = radix_tree_deref_slot(pagep);
 		if (unlikely(!page || page == RADIX_TREE_RETRY))
 			goto repeat;
+		/* the shadow entry of an evicted page */
+		if (radix_tree_exceptional_entry(page)) {
+			page = NULL;
+			goto out;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -661,6 +798,7 @@ repeat:
 			goto repeat;
 		}
 	}
+out:
 	rcu_read_unlock();
 
 	return page;
@@ -757,45 +895,65 @@ EXPORT_SYMBOL(find_or_create_page);
  *
  * The search returns a group of mapping-contiguous pages with ascending
  * indexes.  There may be holes in the indices due to not-present pages.
+ * Shadow entries of evicted pages are skipped over: the tree is looked up
+ * in batches until @nr_pages pages are found or the tree is exhausted,
+ * as callers take a return of zero to mean there are no more pages.
  *
  * find_get_pages() returns the number of pages which were found.
  */
 unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 			    unsigned int nr_pages, struct page **pages)
 {
+	unsigned long indices[PAGEVEC_SIZE];
 	unsigned int i;
 	unsigned int ret;
-	unsigned int nr_found;
+	unsigned int nr, nr_found;
+	pgoff_t index;
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
 	ret = 0;
-	for (i = 0; i < nr_found; i++) {
-		struct page *page;
+	index = start;
+	while (ret < nr_pages) {
+		void ***slots = (void ***)pages + ret;
+
+		nr = min_t(unsigned int, nr_pages - ret, PAGEVEC_SIZE);
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots, indices, index, nr);
+		if (!nr_found)
+			break;
+		index = indices[nr_found - 1] + 1;
+
+		for (i = 0; i < nr_found; i++) {
+			struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
-		if (unlikely(!page))
-			continue;
-		/*
-		 * this can only trigger if nr_found == 1, making livelock
-		 * a non issue.
-		 */
-		if (unlikely(page == RADIX_TREE_RETRY))
-			goto restart;
+			page = radix_tree_deref_slot((void **)slots[i]);
+			if (unlikely(!page))
+				continue;
+			/*
+			 * this can only trigger if nr_found == 1 on the
+			 * first lookup, making livelock a non issue.
+			 */
+			if (unlikely(page == RADIX_TREE_RETRY))
+				goto restart;
+			if (radix_tree_exceptional_entry(page))
+				continue;
 
-		if (!page_cache_get_speculative(page))
-			goto repeat;
+			if (!page_cache_get_speculative(page))
+				goto repeat;
 
-		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
-			page_cache_release(page);
-			goto repeat;
-		}
+			/* Has the page moved? */
+			if (unlikely(page != *((void **)slots[i]))) {
+				page_cache_release(page);
+				goto repeat;
+			}
 
-		pages[ret] = page;
-		ret++;
+			pages[ret] = page;
+			ret++;
+		}
+		/* end of the tree, or 32-bit wraparound */
+		if (nr_found < nr || !index)
+			break;
 	}
 	rcu_read_unlock();
 	return ret;
@@ -823,7 +981,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
+				(void ***)pages, NULL, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -838,6 +996,10 @@ repeat:
 		if (unlikely(page == RADIX_TREE_RETRY))
 			goto restart;
 
+		/* a shadow entry is a hole in the page cache */
+		if (radix_tree_exceptional_entry(page))
+			break;
+
 		if (page->mapping == NULL || page->index != index)
 			break;
 
@@ -32,6 +32,9 @@
 #include <linux/mmu_notifier.h>
 #include <linux/swap.h>
 #include <linux/ksm.h>
+#ifdef CONFIG_HAS_EARLYSUSPEND
+#include <linux/earlysuspend.h>
+#endif
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -111,6 +114,7 @@ struct ksm_scan {
  * @link: link into mm_slot's rmap_list (rmap_list is per mm)
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
+ * @age: number of scans the page was found unchanged and unmerged
  * @oldchecksum: previous checksum of the page at that virtual address
  * @node: rb_node of this rmap_item in either unstable or stable tree
  * @next: next rmap_item hanging off the same node of the stable tree
@@ -120,6 +124,7 @@ struct rmap_item {
 	struct list_head link;
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
+	unsigned char age;
 	union {
 		unsigned int oldchecksum;		/* when unstable */
 		struct rmap_item *next;			/* when stable */
@@ -172,6 +177,29 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Scale the batch by the merge yield, see ksm_adapt() */
+static unsigned int ksm_thread_adaptive;
+
+/* Number of pages ksmd scans in one batch in adaptive mode */
+static unsigned int ksm_adaptive_pages = 100;
+
+/* Pages scanned and merged since the yield was last sampled */
+static unsigned int ksm_adaptive_scanned;
+static unsigned int ksm_adaptive_merged;
+
+/* The number of times unchanged pages skipped the trees */
+static unsigned long ksm_pages_skipped;
+
+/* Set while the screen is off, adaptive ksmd does not scan then */
+static int ksm_screen_off;
+
+#define KSM_ADAPTIVE_MIN_SHIFT	4	/* smallest batch: pages_to_scan/16 */
+#define KSM_ADAPTIVE_WINDOW	1024	/* pages scanned per yield sample */
+#define KSM_ADAPTIVE_YIELD	64	/* pages scanned per merge when good */
+
+#define KSM_SKIP_AGE		3	/* scans unchanged before skipping */
+#define KSM_MAX_SKIP_SHIFT	3	/* aged pages do every 8th scan at least */
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -1066,8 +1094,42 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 
 	tree_rmap_item->next = rmap_item;
 	rmap_item->address |= STABLE_FLAG;
+	rmap_item->age = 0;
 
 	ksm_pages_sharing++;
+	ksm_adaptive_merged++;
+}
+
+/*
+ * In adaptive mode, a page whose checksum has not changed over a few
+ * scans without being merged is unlikely to be merged in the next one:
+ * it only goes through the stable and unstable trees on scans whose
+ * seqnr is a multiple of a power of two that grows with its age, up to
+ * 1 << KSM_MAX_SKIP_SHIFT.  Keying on the global seqnr, rather than on
+ * a per-page countdown, puts all aged pages into the same unstable tree
+ * on those scans, so two identical aged pages still meet.  A change to
+ * its contents or a merge makes the page young again.
+ */
+static bool ksm_skip_unchanged(struct page *page, struct rmap_item *rmap_item,
+			       unsigned int checksum)
+{
+	unsigned long period;
+
+	if (PageKsm(page) || rmap_item->oldchecksum != checksum) {
+		rmap_item->age = 0;
+		return false;
+	}
+
+	if (rmap_item->age < KSM_SKIP_AGE + KSM_MAX_SKIP_SHIFT)
+		rmap_item->age++;
+	if (rmap_item->age <= KSM_SKIP_AGE)
+		return false;
+
+	period = 1UL << (rmap_item->age - KSM_SKIP_AGE);
+	if (!(ksm_scan.seqnr & (period - 1)))
+		return false;
+	ksm_pages_skipped++;
+	return true;
 }
 
 /*
@@ -1089,6 +1151,10 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	if (in_stable_tree(rmap_item))
 		remove_rmap_item_from_tree(rmap_item);
 
+	checksum = calc_checksum(page);
+	if (ksm_thread_adaptive && ksm_skip_unchanged(page, rmap_item, checksum))
+		return;
+
 	/* We first start with searching the page inside the stable tree */
 	tree_rmap_item = stable_tree_search(page, page2, rmap_item);
 	if (tree_rmap_item) {
@@ -1125,7 +1191,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it to the unstable tree, and we don't want to
 	 * waste our time to search if there is something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1343,17 +1408,63 @@ static void ksm_do_scan(unsigned int scan_npages)
 
 static int ksmd_should_run(void)
 {
+	if (ksm_thread_adaptive && ksm_screen_off)
+		return 0;
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
+/*
+ * The batch of adaptive ksmd is doubled after each KSM_ADAPTIVE_WINDOW
+ * pages scanned that merged at least one page in KSM_ADAPTIVE_YIELD,
+ * and halved after those that merged none, between pages_to_scan/16
+ * and pages_to_scan.  While more tasks are runnable than there are cpus,
+ * the smallest batch is scanned.
+ */
+static unsigned int ksm_scan_batch(void)
+{
+	unsigned int max_pages = ksm_thread_pages_to_scan;
+	unsigned int min_pages = max_pages >> KSM_ADAPTIVE_MIN_SHIFT;
+
+	if (!ksm_thread_adaptive)
+		return max_pages;
+
+	min_pages = max(min_pages, 1U);
+	ksm_adaptive_pages = clamp(ksm_adaptive_pages, min_pages, max_pages);
+	if (nr_running() > num_online_cpus())
+		return min_pages;
+	return ksm_adaptive_pages;
+}
+
+static void ksm_adapt(unsigned int scanned)
+{
+	if (!ksm_thread_adaptive)
+		return;
+
+	ksm_adaptive_scanned += scanned;
+	if (ksm_adaptive_scanned < KSM_ADAPTIVE_WINDOW)
+		return;
+
+	if (ksm_adaptive_merged * KSM_ADAPTIVE_YIELD >= ksm_adaptive_scanned)
+		ksm_adaptive_pages *= 2;
+	else if (!ksm_adaptive_merged)
+		ksm_adaptive_pages /= 2;
+	ksm_adaptive_scanned = 0;
+	ksm_adaptive_merged = 0;
+}
+
 static int ksm_scan_thread(void *nothing)
 {
+	unsigned int batch;
+
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			batch = ksm_scan_batch();
+			ksm_do_scan(batch);
+			ksm_adapt(batch);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		if (ksmd_should_run()) {
@@ -1536,6 +1647,46 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t adaptive_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_adaptive);
+}
+
+static ssize_t adaptive_store(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      const char *buf, size_t count)
+{
+	int err;
+	unsigned long adaptive;
+
+	err = strict_strtoul(buf, 10, &adaptive);
+	if (err || adaptive > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_thread_adaptive != adaptive) {
+		ksm_thread_adaptive = adaptive;
+		ksm_adaptive_pages = ksm_thread_pages_to_scan;
+		ksm_adaptive_scanned = 0;
+		ksm_adaptive_merged = 0;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	/* ksmd may be waiting for the screen to come on */
+	wake_up_interruptible(&ksm_thread_wait);
+
+	return count;
+}
+KSM_ATTR(adaptive);
+
+static ssize_t adaptive_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_pages);
+}
+KSM_ATTR_RO(adaptive_pages);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1651,9 +1802,18 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&adaptive_attr.attr,
+	&adaptive_pages_attr.attr,
 	&run_attr.attr,
 	&max_kernel_pages_attr.attr,
 	&pages_shared_attr.attr,
@@ -1661,6 +1821,7 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_skipped_attr.attr,
 	NULL,
 };
 
@@ -1670,6 +1831,25 @@ static struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+#ifdef CONFIG_HAS_EARLYSUSPEND
+static void ksm_early_suspend(struct early_suspend *handler)
+{
+	ksm_screen_off = 1;
+}
+
+static void ksm_late_resume(struct early_suspend *handler)
+{
+	ksm_screen_off = 0;
+	wake_up_interruptible(&ksm_thread_wait);
+}
+
+static struct early_suspend ksm_early_suspend_handler = {
+	.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN + 1,
+	.suspend = ksm_early_suspend,
+	.resume = ksm_late_resume,
+};
+#endif
+
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
@@ -1704,6 +1884,9 @@ static int __init ksm_init(void)
 
 #endif /* CONFIG_SYSFS */
 
+#ifdef CONFIG_HAS_EARLYSUSPEND
+	register_early_suspend(&ksm_early_suspend_handler);
+#endif
 	return 0;
 
 out_free2:
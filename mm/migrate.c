@@ -645,6 +645,15 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	if (PageAnon(page)) {
 		rcu_read_lock();
 		rcu_locked = 1;
+
+		/*
+		 * An anon page found by a pfn walk, as compaction does, may
+		 * have been unmapped after isolation, and its anon_vma freed
+		 * unless the swap cache still holds it.  Leave such a page
+		 * alone, it is about to be freed.
+		 */
+		if (!page_mapped(page) && !PageSwapCache(page))
+			goto rcu_unlock;
 	}
 
 	/*
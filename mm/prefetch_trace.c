@@ -0,0 +1,506 @@
+/*
+ * mm/prefetch_trace.c - record and replay of page cache reads
+ *
+ * While recording, every readahead that goes to disk logs the file and
+ * the range of pages it reads.  When recording stops, the log is sorted
+ * by file and offset, ranges that are close together are merged, and
+ * the result is made available as a trace that userspace saves to disk.
+ *
+ * Writing a saved trace back replays it: the files are opened in the
+ * order they were first read and their ranges are read ahead in offset
+ * order, so that the scattered small reads of a cold boot or of the
+ * first launch of an application become a few large sequential ones
+ * issued before they are needed.
+ *
+ * Only reads that miss the page cache are seen, so a recording made
+ * while a replay has already warmed the cache misses what the replay
+ * read: the trace should be recorded on a boot without replay.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/hash.h>
+#include <linux/kobject.h>
+#include <linux/mount.h>
+#include <linux/path.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/vmalloc.h>
+#include <linux/prefetch_trace.h>
+
+#define PREFETCH_MAX_FILES	1024
+#define PREFETCH_HASH_BITS	11	/* twice PREFETCH_MAX_FILES */
+#define PREFETCH_MAX_RECORDS	32768
+
+/* ranges of a file less than this many pages apart are read as one */
+#define PREFETCH_MERGE_GAP	8
+
+/* largest trace accepted for replay */
+#define PREFETCH_MAX_TRACE	(4 << 20)
+
+struct prefetch_file {
+	struct path path;
+	struct address_space *mapping;
+};
+
+struct prefetch_record {
+	u32 file;
+	u32 start;
+	u32 end;		/* last page */
+};
+
+int prefetch_recording __read_mostly;
+
+/* protects the recording state below against the readahead hook */
+static DEFINE_SPINLOCK(prefetch_lock);
+static struct prefetch_file *prefetch_files;
+static unsigned int prefetch_nr_files;
+static s16 *prefetch_hash;
+static struct prefetch_record *prefetch_records;
+static unsigned int prefetch_nr_records;
+static unsigned long prefetch_dropped;
+
+/* serializes starting and stopping a recording, and replays */
+static DEFINE_MUTEX(prefetch_mutex);
+
+/* the trace of the last recording */
+static void *prefetch_trace;
+static size_t prefetch_trace_size;
+
+/* a trace being written to the replay file */
+static void *prefetch_replay_buf;
+static size_t prefetch_replay_len;
+static struct task_struct *prefetch_replay_task;
+
+/* Called with prefetch_lock held */
+static int prefetch_file_index(struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	unsigned int h = hash_ptr(mapping, PREFETCH_HASH_BITS);
+	int idx;
+
+	while ((idx = prefetch_hash[h]) >= 0) {
+		if (prefetch_files[idx].mapping == mapping)
+			return idx;
+		h = (h + 1) & ((1 << PREFETCH_HASH_BITS) - 1);
+	}
+
+	if (prefetch_nr_files == PREFETCH_MAX_FILES)
+		return -1;
+	idx = prefetch_nr_files++;
+	prefetch_files[idx].path = file->f_path;
+	path_get(&file->f_path);
+	prefetch_files[idx].mapping = mapping;
+	prefetch_hash[h] = idx;
+	return idx;
+}
+
+void __prefetch_trace_record(struct file *file, pgoff_t start,
+			     unsigned long nr_pages)
+{
+	struct prefetch_record *r;
+	int idx;
+
+	if (!S_ISREG(file->f_mapping->host->i_mode) ||
+	    current == prefetch_replay_task)
+		return;
+	if (start + nr_pages - 1 > UINT_MAX)
+		return;
+
+	spin_lock(&prefetch_lock);
+	if (!prefetch_recording)
+		goto out;
+	idx = prefetch_file_index(file);
+	if (idx < 0 || prefetch_nr_records == PREFETCH_MAX_RECORDS) {
+		prefetch_dropped++;
+		goto out;
+	}
+	r = &prefetch_records[prefetch_nr_records++];
+	r->file = idx;
+	r->start = start;
+	r->end = start + nr_pages - 1;
+out:
+	spin_unlock(&prefetch_lock);
+}
+
+static void prefetch_free_recording(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < prefetch_nr_files; i++)
+		path_put(&prefetch_files[i].path);
+	vfree(prefetch_files);
+	vfree(prefetch_records);
+	kfree(prefetch_hash);
+	prefetch_files = NULL;
+	prefetch_records = NULL;
+	prefetch_hash = NULL;
+	prefetch_nr_files = 0;
+	prefetch_nr_records = 0;
+	prefetch_dropped = 0;
+}
+
+static int prefetch_start_recording(void)
+{
+	if (prefetch_recording)
+		return 0;
+
+	prefetch_files = vmalloc(PREFETCH_MAX_FILES * sizeof(*prefetch_files));
+	prefetch_records = vmalloc(PREFETCH_MAX_RECORDS *
+				   sizeof(*prefetch_records));
+	prefetch_hash = kmalloc(sizeof(*prefetch_hash) <<
+				PREFETCH_HASH_BITS, GFP_KERNEL);
+	if (!prefetch_files || !prefetch_records || !prefetch_hash) {
+		prefetch_free_recording();
+		return -ENOMEM;
+	}
+	memset(prefetch_hash, -1, sizeof(*prefetch_hash) << PREFETCH_HASH_BITS);
+
+	spin_lock(&prefetch_lock);
+	prefetch_recording = 1;
+	spin_unlock(&prefetch_lock);
+	return 0;
+}
+
+static int prefetch_record_cmp(const void *a, const void *b)
+{
+	const struct prefetch_record *ra = a, *rb = b;
+
+	if (ra->file != rb->file)
+		return ra->file < rb->file ? -1 : 1;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+/* Sort the records by file and offset and merge them into ranges */
+static unsigned int prefetch_merge_records(void)
+{
+	struct prefetch_record *r = prefetch_records, *cur;
+	unsigned int i, nr;
+
+	if (!prefetch_nr_records)
+		return 0;
+
+	sort(r, prefetch_nr_records, sizeof(*r), prefetch_record_cmp, NULL);
+
+	cur = r;
+	for (i = 1, nr = 1; i < prefetch_nr_records; i++) {
+		if (r[i].file == cur->file &&
+		    r[i].start <= cur->end + PREFETCH_MERGE_GAP) {
+			cur->end = max(cur->end, r[i].end);
+			continue;
+		}
+		cur = &r[nr++];
+		*cur = r[i];
+	}
+	return nr;
+}
+
+/* Build the trace from a stopped recording, called with prefetch_mutex */
+static int prefetch_build_trace(void)
+{
+	struct prefetch_trace_header *hdr;
+	struct prefetch_trace_range *range;
+	struct prefetch_trace_file *tf;
+	unsigned int nr_ranges, nr_files, i;
+	char **names, *page, *p;
+	s16 *map = prefetch_hash;	/* reused as old to new file index */
+	size_t size;
+	int err = -ENOMEM;
+
+	nr_ranges = prefetch_merge_records();
+
+	names = kcalloc(prefetch_nr_files, sizeof(*names), GFP_KERNEL);
+	page = (char *)__get_free_page(GFP_KERNEL);
+	if (!names || !page)
+		goto out;
+
+	size = sizeof(*hdr);
+	for (i = 0, nr_files = 0; i < prefetch_nr_files; i++) {
+		struct path *path = &prefetch_files[i].path;
+
+		map[i] = -1;
+		if (d_unlinked(path->dentry))
+			continue;
+		p = d_path(path, page, PAGE_SIZE);
+		if (IS_ERR(p) || strlen(p) >= USHORT_MAX)
+			continue;
+		names[i] = kstrdup(p, GFP_KERNEL);
+		if (!names[i])
+			goto out;
+		map[i] = nr_files++;
+		size += ALIGN(sizeof(*tf) + strlen(p) + 1, 4);
+	}
+	for (i = 0; i < nr_ranges; i++)
+		if (map[prefetch_records[i].file] >= 0)
+			size += sizeof(*range);
+
+	vfree(prefetch_trace);
+	prefetch_trace_size = 0;
+	prefetch_trace = vmalloc(size);
+	if (!prefetch_trace)
+		goto out;
+	memset(prefetch_trace, 0, size);
+
+	hdr = prefetch_trace;
+	hdr->magic = PREFETCH_TRACE_MAGIC;
+	hdr->size = size;
+	hdr->nr_files = nr_files;
+	p = prefetch_trace + sizeof(*hdr);
+	for (i = 0; i < prefetch_nr_files; i++) {
+		if (map[i] < 0)
+			continue;
+		tf = (struct prefetch_trace_file *)p;
+		tf->len = strlen(names[i]) + 1;
+		memcpy(tf->path, names[i], tf->len);
+		p += ALIGN(sizeof(*tf) + tf->len, 4);
+	}
+	range = (struct prefetch_trace_range *)p;
+	for (i = 0; i < nr_ranges; i++) {
+		struct prefetch_record *r = &prefetch_records[i];
+
+		if (map[r->file] < 0)
+			continue;
+		range->file = map[r->file];
+		range->start = r->start;
+		range->nr_pages = r->end - r->start + 1;
+		range++;
+		hdr->nr_ranges++;
+	}
+	prefetch_trace_size = size;
+
+	printk(KERN_INFO "prefetch: recorded %u files, %u ranges, "
+	       "%lu reads dropped\n", nr_files, hdr->nr_ranges,
+	       prefetch_dropped);
+	err = 0;
+out:
+	if (names) {
+		for (i = 0; i < prefetch_nr_files; i++)
+			kfree(names[i]);
+		kfree(names);
+	}
+	free_page((unsigned long)page);
+	return err;
+}
+
+static int prefetch_stop_recording(void)
+{
+	int err;
+
+	if (!prefetch_recording)
+		return 0;
+
+	spin_lock(&prefetch_lock);
+	prefetch_recording = 0;
+	spin_unlock(&prefetch_lock);
+
+	err = prefetch_build_trace();
+	prefetch_free_recording();
+	return err;
+}
+
+/* Check a complete trace and read ahead its ranges */
+static int prefetch_replay(void *trace)
+{
+	struct prefetch_trace_header *hdr = trace;
+	struct prefetch_trace_range *range;
+	struct prefetch_trace_file *tf;
+	struct file *filp = NULL;
+	char **names;
+	unsigned int i, cur = 0;
+	void *p, *end = trace + hdr->size;
+	int err = -EINVAL;
+
+	if (hdr->nr_files > PREFETCH_MAX_TRACE / sizeof(*tf))
+		return -EINVAL;
+	names = kcalloc(hdr->nr_files, sizeof(*names), GFP_KERNEL);
+	if (!names)
+		return -ENOMEM;
+
+	p = trace + sizeof(*hdr);
+	for (i = 0; i < hdr->nr_files; i++) {
+		tf = p;
+		if (p + sizeof(*tf) > end || !tf->len ||
+		    p + sizeof(*tf) + tf->len > end ||
+		    tf->path[tf->len - 1] != '\0')
+			goto out;
+		names[i] = tf->path;
+		p += ALIGN(sizeof(*tf) + tf->len, 4);
+	}
+	if (hdr->nr_ranges > PREFETCH_MAX_TRACE / sizeof(*range) ||
+	    p + hdr->nr_ranges * sizeof(*range) != end)
+		goto out;
+
+	prefetch_replay_task = current;
+	for (range = p; (void *)range < end; range++) {
+		if (range->file >= hdr->nr_files || fatal_signal_pending(current))
+			break;
+		if (!filp || range->file != cur) {
+			if (filp && !IS_ERR(filp))
+				fput(filp);
+			cur = range->file;
+			/*
+			 * The path may name something else by now: don't
+			 * block on a FIFO, and only read regular files.
+			 */
+			filp = filp_open(names[cur], O_RDONLY | O_LARGEFILE |
+					 O_NONBLOCK | O_NOATIME, 0);
+			if (!IS_ERR(filp) &&
+			    !S_ISREG(filp->f_path.dentry->d_inode->i_mode)) {
+				fput(filp);
+				filp = ERR_PTR(-EINVAL);
+			}
+		}
+		if (IS_ERR(filp))
+			continue;
+		force_page_cache_readahead(filp->f_mapping, filp,
+					   range->start, range->nr_pages);
+	}
+	if (filp && !IS_ERR(filp))
+		fput(filp);
+	prefetch_replay_task = NULL;
+	err = 0;
+out:
+	kfree(names);
+	return err;
+}
+
+#define PREFETCH_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t record_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	return sprintf(buf, "%d\n", prefetch_recording);
+}
+
+static ssize_t record_store(struct kobject *kobj, struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	unsigned long record;
+	int err;
+
+	err = strict_strtoul(buf, 10, &record);
+	if (err || record > 1)
+		return -EINVAL;
+
+	mutex_lock(&prefetch_mutex);
+	if (record)
+		err = prefetch_start_recording();
+	else
+		err = prefetch_stop_recording();
+	mutex_unlock(&prefetch_mutex);
+
+	return err ? err : count;
+}
+PREFETCH_ATTR(record);
+
+static ssize_t trace_read(struct kobject *kobj, struct bin_attribute *attr,
+			  char *buf, loff_t off, size_t count)
+{
+	ssize_t ret;
+
+	mutex_lock(&prefetch_mutex);
+	ret = memory_read_from_buffer(buf, count, &off, prefetch_trace,
+				      prefetch_trace_size);
+	mutex_unlock(&prefetch_mutex);
+	return ret;
+}
+
+static ssize_t replay_write(struct kobject *kobj, struct bin_attribute *attr,
+			    char *buf, loff_t off, size_t count)
+{
+	struct prefetch_trace_header *hdr = (void *)buf;
+	ssize_t ret = count;
+	int err;
+
+	mutex_lock(&prefetch_mutex);
+	if (off == 0) {
+		vfree(prefetch_replay_buf);
+		prefetch_replay_buf = NULL;
+		prefetch_replay_len = 0;
+		if (count < sizeof(*hdr) || hdr->magic != PREFETCH_TRACE_MAGIC ||
+		    hdr->size < sizeof(*hdr) || hdr->size > PREFETCH_MAX_TRACE) {
+			ret = -EINVAL;
+			goto out;
+		}
+		prefetch_replay_buf = vmalloc(hdr->size);
+		if (!prefetch_replay_buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	} else if (!prefetch_replay_buf || off != prefetch_replay_len) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	hdr = prefetch_replay_buf;
+	if (off == 0)
+		hdr->size = ((struct prefetch_trace_header *)buf)->size;
+	if (prefetch_replay_len + count > hdr->size) {
+		ret = -EINVAL;
+		goto out_free;
+	}
+	memcpy(prefetch_replay_buf + prefetch_replay_len, buf, count);
+	prefetch_replay_len += count;
+
+	if (prefetch_replay_len < hdr->size)
+		goto out;
+	err = prefetch_replay(prefetch_replay_buf);
+	if (err)
+		ret = err;
+out_free:
+	vfree(prefetch_replay_buf);
+	prefetch_replay_buf = NULL;
+	prefetch_replay_len = 0;
+out:
+	mutex_unlock(&prefetch_mutex);
+	return ret;
+}
+
+static struct bin_attribute trace_attr = {
+	.attr = { .name = "trace", .mode = 0400 },
+	.read = trace_read,
+};
+
+static struct bin_attribute replay_attr = {
+	.attr = { .name = "replay", .mode = 0200 },
+	.write = replay_write,
+};
+
+static struct attribute *prefetch_attrs[] = {
+	&record_attr.attr,
+	NULL,
+};
+
+static struct attribute_group prefetch_attr_group = {
+	.attrs = prefetch_attrs,
+};
+
+static int __init prefetch_trace_init(void)
+{
+	struct kobject *kobj;
+	int err;
+
+	kobj = kobject_create_and_add("prefetch", mm_kobj);
+	if (!kobj)
+		return -ENOMEM;
+
+	err = sysfs_create_group(kobj, &prefetch_attr_group);
+	if (!err)
+		err = sysfs_create_bin_file(kobj, &trace_attr);
+	if (!err)
+		err = sysfs_create_bin_file(kobj, &replay_attr);
+	if (err) {
+		printk(KERN_ERR "prefetch: register sysfs failed\n");
+		kobject_put(kobj);
+	}
+	return err;
+}
+module_init(prefetch_trace_init)
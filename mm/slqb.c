@@ -20,6 +20,8 @@
 #include <linux/kallsyms.h>
 #include <linux/memory.h>
 #include <linux/fault-inject.h>
+#include <linux/kmemtrace.h>
+#include <linux/microbench.h>
 
 /*
  * TODO
@@ -1597,14 +1599,23 @@ static __always_inline void *__kmem_cache_alloc(struct kmem_cache *s,
 
 void *kmem_cache_alloc(struct kmem_cache *s, gfp_t gfpflags)
 {
-	return __kmem_cache_alloc(s, gfpflags, _RET_IP_);
+	void *ret = __kmem_cache_alloc(s, gfpflags, _RET_IP_);
+
+	trace_kmem_cache_alloc(_RET_IP_, ret, s->objsize, s->size, gfpflags);
+
+	return ret;
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
 #ifdef CONFIG_NUMA
 void *kmem_cache_alloc_node(struct kmem_cache *s, gfp_t gfpflags, int node)
 {
-	return slab_alloc(s, gfpflags, node, _RET_IP_);
+	void *ret = slab_alloc(s, gfpflags, node, _RET_IP_);
+
+	trace_kmem_cache_alloc_node(_RET_IP_, ret, s->objsize, s->size,
+				    gfpflags, node);
+
+	return ret;
 }
 EXPORT_SYMBOL(kmem_cache_alloc_node);
 #endif
@@ -1808,9 +1819,168 @@ void kmem_cache_free(struct kmem_cache *s, void *object)
 	if (slab_numa(s))
 		page = virt_to_head_slqb_page(object);
 	slab_free(s, page, object);
+
+	trace_kmem_cache_free(_RET_IP_, object);
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk allocation and freeing go through the per-CPU queue in a single
+ * pass with interrupts disabled.  Debug caches take the slow path one
+ * object at a time.  Each object gets its own kmem_cache_alloc or
+ * kmem_cache_free event, as it would through the single-object calls.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfpflags, size_t nr,
+			  void **p)
+{
+	unsigned long flags;
+	int node = -1;
+	size_t i;
+
+	if (unlikely(slab_debug(s))) {
+		for (i = 0; i < nr; i++) {
+			p[i] = kmem_cache_alloc(s, gfpflags);
+			if (unlikely(!p[i]))
+				goto error;
+		}
+		return nr;
+	}
+
+	gfpflags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfpflags);
+	might_sleep_if(gfpflags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, gfpflags))
+		return 0;
+
+#ifdef CONFIG_NUMA
+	if (unlikely(current->flags & (PF_SPREAD_SLAB | PF_MEMPOLICY)))
+		node = alternate_nid(s, gfpflags, node);
+#endif
+	local_irq_save(flags);
+	for (i = 0; i < nr; i++) {
+		p[i] = __slab_alloc(s, gfpflags, node);
+		if (unlikely(!p[i]))
+			break;
+	}
+	local_irq_restore(flags);
+	if (unlikely(i < nr))
+		goto error;
+
+	if (unlikely(gfpflags & __GFP_ZERO)) {
+		for (i = 0; i < nr; i++)
+			memset(p[i], 0, s->objsize);
+	}
+	for (i = 0; i < nr; i++)
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->objsize, s->size,
+				       gfpflags);
+	return nr;
+
+error:
+	kmem_cache_free_bulk(s, i, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	if (unlikely(slab_debug(s))) {
+		for (i = 0; i < nr; i++)
+			kmem_cache_free(s, p[i]);
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		prefetchw(p[i]);
+		debug_check_no_locks_freed(p[i], s->objsize);
+	}
+
+	local_irq_save(flags);
+	for (i = 0; i < nr; i++) {
+		struct slqb_page *page = NULL;
+
+		if (slab_numa(s))
+			page = virt_to_head_slqb_page(p[i]);
+		__slab_free(s, page, p[i]);
+	}
+#ifdef CONFIG_SMP
+	/* Objects of remote nodes are handed back once per bulk free */
+	if (NUMA_BUILD && slab_numa(s))
+		flush_remote_free_cache(s,
+				get_cpu_slab(s, smp_processor_id()));
+#endif
+	local_irq_restore(flags);
+
+	for (i = 0; i < nr; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+#ifdef CONFIG_DEBUG_MICROBENCH
+/*
+ * /sys/kernel/debug/bench/slqb_bulk allocates and frees objects of a
+ * scratch cache one at a time and in bulk, in batches of
+ * SLQB_BENCH_BATCH, and reports the time taken per object for each.
+ */
+#define SLQB_BENCH_LOOPS	100000
+#define SLQB_BENCH_BATCH	16
+#define SLQB_BENCH_SIZE		256
+
+static int slqb_bulk_bench_run(char *buf, size_t size)
+{
+	void *objs[SLQB_BENCH_BATCH];
+	struct kmem_cache *s;
+	u64 single_ns = 0, bulk_ns = 0;
+	ktime_t start;
+	int i, j, len;
+
+	s = kmem_cache_create("slqb_bench", SLQB_BENCH_SIZE, 0, 0, NULL);
+	if (!s)
+		return -ENOMEM;
+
+	for (i = 0; i < SLQB_BENCH_LOOPS; i += SLQB_BENCH_BATCH) {
+		start = ktime_get();
+		for (j = 0; j < SLQB_BENCH_BATCH; j++) {
+			objs[j] = kmem_cache_alloc(s, GFP_KERNEL);
+			if (!objs[j])
+				break;
+		}
+		while (j--)
+			kmem_cache_free(s, objs[j]);
+		single_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		if (kmem_cache_alloc_bulk(s, GFP_KERNEL, SLQB_BENCH_BATCH,
+					  objs))
+			kmem_cache_free_bulk(s, SLQB_BENCH_BATCH, objs);
+		bulk_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		cond_resched();
+	}
+	kmem_cache_destroy(s);
+
+	len = microbench_print(buf, size, "single", single_ns,
+			       SLQB_BENCH_LOOPS, "object");
+	len += microbench_print(buf + len, size - len, "bulk", bulk_ns,
+				SLQB_BENCH_LOOPS, "object");
+	return len;
+}
+
+static struct microbench slqb_bulk_bench = {
+	.name	= "slqb_bulk",
+	.run	= slqb_bulk_bench_run,
+};
+
+static int __init slqb_bulk_bench_init(void)
+{
+	return microbench_register(&slqb_bulk_bench);
+}
+late_initcall(slqb_bulk_bench_init);
+#endif /* CONFIG_DEBUG_MICROBENCH */
+
 /*
  * Calculate the order of allocation given an slab object size.
  *
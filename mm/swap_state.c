@@ -132,6 +132,9 @@ void __delete_from_swap_cache(struct page *page)
 	radix_tree_delete(&swapper_space.page_tree, page_private(page));
 	set_page_private(page, 0);
 	ClearPageSwapCache(page);
+	/* read ahead, but dropped before anybody looked it up */
+	if (TestClearPageReadahead(page))
+		__count_vm_event(SWAP_RA_MISS);
 	total_swapcache_pages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
 	INC_CACHE_INFO(del_total);
@@ -256,27 +259,37 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
  */
+/*
+ * Account a page found in the swap cache as a readahead hit if
+ * swapin_readahead() read it.  PG_readahead shares its bit with
+ * PG_reclaim, which is only meaningful under writeback.
+ */
+static inline void swap_readahead_hit(struct page *page, swp_entry_t entry)
+{
+	if (!PageWriteback(page) && TestClearPageReadahead(page)) {
+		count_vm_event(SWAP_RA_HIT);
+		atomic_inc(&get_swap_info_struct(swp_type(entry))->ra_hits);
+	}
+}
+
 struct page * lookup_swap_cache(swp_entry_t entry)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		swap_readahead_hit(page, entry);
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
- * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
- */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			int readahead)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -330,6 +343,10 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 * Initiate read into locked page and return.
 			 */
 			lru_cache_add_anon(new_page);
+			if (readahead) {
+				SetPageReadahead(new_page);
+				count_vm_event(SWAP_RA);
+			}
 			swap_readpage(new_page);
 			return new_page;
 		}
@@ -348,6 +365,18 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, 0);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -358,9 +387,14 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
  * Returns the struct page for entry and addr, after queueing swapin.
  *
  * Primitive swap readahead code. We simply read an aligned block of
- * (1 << page_cluster) entries in the swap area. This method is chosen
- * because it doesn't cost us any seek time.  We also make sure to queue
- * the 'original' request together with the readahead ones...
+ * entries in the swap area, sized by the readahead policy of the swap
+ * device (see valid_swaphandles()). This method is chosen because it
+ * doesn't cost us any seek time.  We also make sure to queue the
+ * 'original' request together with the readahead ones...
+ *
+ * Pages read ahead are marked PG_readahead until they are looked up,
+ * which the adaptive policy and the swap_ra_hit/swap_ra_miss counters
+ * in /proc/vmstat go by.
  *
  * This has been extended to use the NUMA policies from the mm triggering
  * the readahead.
@@ -385,12 +419,17 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(swp_entry(swp_type(entry),
+						offset), gfp_mask, vma, addr,
+						offset != swp_offset(entry));
 		if (!page)
 			break;
 		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
-	return read_swap_cache_async(entry, gfp_mask, vma, addr);
+	page = read_swap_cache_async(entry, gfp_mask, vma, addr);
+	/* a racing readahead may have brought it in */
+	if (page)
+		swap_readahead_hit(page, entry);
+	return page;
 }
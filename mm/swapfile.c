@@ -26,9 +26,11 @@
 #include <linux/security.h>
 #include <linux/backing-dev.h>
 #include <linux/mutex.h>
+#include <linux/cpu.h>
 #include <linux/capability.h>
 #include <linux/syscalls.h>
 #include <linux/memcontrol.h>
+#include <linux/log2.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -456,14 +458,14 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/* Allocate a slot for the swap cache, called with swap_lock held */
+static swp_entry_t __get_swap_page(void)
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
 
-	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
 	nr_swap_pages--;
@@ -485,19 +487,127 @@ swp_entry_t get_swap_page(void)
 		swap_list.next = next;
 		/* This is called for allocating swap entry for cache */
 		offset = scan_swap_map(si, SWAP_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
+		if (offset)
 			return swp_entry(type, offset);
-		}
 		next = swap_list.next;
 	}
 
 	nr_swap_pages++;
 noswap:
-	spin_unlock(&swap_lock);
 	return (swp_entry_t) {0};
 }
 
+/*
+ * Per-cpu swap slot caches.  get_swap_page() hands out slots from a
+ * batch reserved in one swap_lock hold, and slots whose last reference
+ * is dropped are queued and released in one go when the queue fills.
+ * Neither kind of slot is counted in nr_swap_pages.  Reserved slots read
+ * SWAP_HAS_CACHE in swap_map from the start, as if just allocated, so
+ * handing one out takes no lock but alloc_lock; queued slots read
+ * SWAP_SLOT_CACHED until they are released.
+ *
+ * The allocation batch is protected by alloc_lock, as scan_swap_map()
+ * may sleep.  The release queue is only used under swap_lock.
+ */
+#define SWAP_SLOTS_BATCH	64
+
+/*
+ * swap_map value of a slot queued for release.  It has no users and no
+ * swap cache page, so swapcache_prepare() and swap_duplicate() fail with
+ * -ENOENT as for a free slot, while scan_swap_map() sees it as in use and
+ * the scans that skip SWAP_MAP_BAD slots skip it too.
+ */
+#define SWAP_SLOT_CACHED	(SWAP_HAS_CACHE | SWAP_MAP_BAD)
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;
+	int		cur;		/* next slot to hand out */
+	int		nr;		/* slots left from cur */
+	swp_entry_t	slots[SWAP_SLOTS_BATCH];
+	int		nr_ret;		/* slots queued for release */
+	swp_entry_t	slots_ret[SWAP_SLOTS_BATCH];
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swap_slots);
+static int swap_slots_ready;
+
+static void drain_swap_slots(void);
+
+/*
+ * Batches are only worth reserving while swap is plentiful, slots
+ * parked in the caches of other cpus must not make allocations fail.
+ */
+static inline int swap_slots_refill_ok(void)
+{
+	return nr_swap_pages > num_online_cpus() * SWAP_SLOTS_BATCH * 2;
+}
+
+/* Whether any cpu's cache holds slots, a hint only */
+static int swap_slots_cached(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swap_slots, cpu);
+
+		if (cache->nr || cache->nr_ret)
+			return 1;
+	}
+	return 0;
+}
+
+static int get_swap_pages(int n, swp_entry_t slots[])
+{
+	int i;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < n; i++) {
+		slots[i] = __get_swap_page();
+		if (!slots[i].val)
+			break;
+	}
+	spin_unlock(&swap_lock);
+	return i;
+}
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry;
+
+	if (swap_slots_ready) {
+		/* the task may migrate, the cache is locked anyway */
+		cache = &per_cpu(swap_slots, raw_smp_processor_id());
+
+		mutex_lock(&cache->alloc_lock);
+		if (!cache->nr && swap_slots_refill_ok()) {
+			cache->cur = 0;
+			cache->nr = get_swap_pages(SWAP_SLOTS_BATCH,
+						   cache->slots);
+		}
+		if (cache->nr) {
+			entry = cache->slots[cache->cur++];
+			cache->nr--;
+			mutex_unlock(&cache->alloc_lock);
+			return entry;
+		}
+		mutex_unlock(&cache->alloc_lock);
+	}
+
+	spin_lock(&swap_lock);
+	entry = __get_swap_page();
+	spin_unlock(&swap_lock);
+
+	/* Out of swap: take back what the caches of all cpus hold, once */
+	if (!entry.val && swap_slots_ready && swap_slots_cached()) {
+		drain_swap_slots();
+		spin_lock(&swap_lock);
+		entry = __get_swap_page();
+		spin_unlock(&swap_lock);
+	}
+	return entry;
+}
+
 /* The only caller of this function is now susupend routine */
 swp_entry_t get_swap_page_of_type(int type)
 {
@@ -556,6 +666,113 @@ out:
 	return NULL;
 }
 
+/* Give an unreferenced slot back to its swap area, under swap_lock */
+static void swap_slot_release(struct swap_info_struct *p, unsigned long offset)
+{
+	struct gendisk *disk = p->bdev->bd_disk;
+
+	if (offset < p->lowest_bit)
+		p->lowest_bit = offset;
+	if (offset > p->highest_bit)
+		p->highest_bit = offset;
+	if (p->prio > swap_info[swap_list.next].prio)
+		swap_list.next = p - swap_info;
+	nr_swap_pages++;
+	p->inuse_pages--;
+	if ((p->flags & SWP_BLKDEV) &&
+		disk->fops->swap_slot_free_notify)
+		disk->fops->swap_slot_free_notify(p->bdev, offset);
+}
+
+/*
+ * Release slots held by a swap slot cache, under swap_lock.  @map is
+ * what their swap_map entries read while cached.
+ */
+static void swap_slots_release(swp_entry_t *slots, int n, unsigned short map)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		struct swap_info_struct *p = swap_info + swp_type(slots[i]);
+		unsigned long offset = swp_offset(slots[i]);
+
+		VM_BUG_ON(p->swap_map[offset] != map);
+		p->swap_map[offset] = 0;
+		swap_slot_release(p, offset);
+	}
+}
+
+/*
+ * Queue an unreferenced slot for release, under swap_lock.  Slots of an
+ * area being swapped off are released at once, so that try_to_unuse()
+ * does not find them, and so are all slots while swap is short, so that
+ * they can be reused and their free notifications (which let zram drop
+ * the compressed page) are not held back.
+ */
+static void swap_slot_free(struct swap_info_struct *p, swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+
+	if (!swap_slots_ready || !(p->flags & SWP_WRITEOK) ||
+	    !swap_slots_refill_ok()) {
+		swap_slot_release(p, swp_offset(entry));
+		return;
+	}
+
+	cache = &__get_cpu_var(swap_slots);
+	if (cache->nr_ret == SWAP_SLOTS_BATCH) {
+		swap_slots_release(cache->slots_ret, cache->nr_ret,
+				   SWAP_SLOT_CACHED);
+		cache->nr_ret = 0;
+	}
+	p->swap_map[swp_offset(entry)] = SWAP_SLOT_CACHED;
+	cache->slots_ret[cache->nr_ret++] = entry;
+}
+
+/* Return the slots cached by @cpu to their swap areas */
+static void drain_swap_slots_cpu(int cpu)
+{
+	struct swap_slots_cache *cache = &per_cpu(swap_slots, cpu);
+
+	mutex_lock(&cache->alloc_lock);
+	spin_lock(&swap_lock);
+	swap_slots_release(cache->slots + cache->cur, cache->nr,
+			   SWAP_HAS_CACHE);
+	cache->nr = 0;
+	swap_slots_release(cache->slots_ret, cache->nr_ret, SWAP_SLOT_CACHED);
+	cache->nr_ret = 0;
+	spin_unlock(&swap_lock);
+	mutex_unlock(&cache->alloc_lock);
+}
+
+static void drain_swap_slots(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		drain_swap_slots_cpu(cpu);
+}
+
+static int swap_slots_cpu_notify(struct notifier_block *self,
+				 unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_swap_slots_cpu((unsigned long)hcpu);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		mutex_init(&per_cpu(swap_slots, cpu).alloc_lock);
+	hotcpu_notifier(swap_slots_cpu_notify, 0);
+	swap_slots_ready = 1;
+	return 0;
+}
+__initcall(swap_slots_init);
+
 static int swap_entry_free(struct swap_info_struct *p,
 			   swp_entry_t ent, int cache)
 {
@@ -578,20 +795,8 @@ static int swap_entry_free(struct swap_info_struct *p,
 	/* return code. */
 	count = p->swap_map[offset];
 	/* free if no reference */
-	if (!count) {
-		struct gendisk *disk = p->bdev->bd_disk;
-		if (offset < p->lowest_bit)
-			p->lowest_bit = offset;
-		if (offset > p->highest_bit)
-			p->highest_bit = offset;
-		if (p->prio > swap_info[swap_list.next].prio)
-			swap_list.next = p - swap_info;
-		nr_swap_pages++;
-		p->inuse_pages--;
-		if ((p->flags & SWP_BLKDEV) &&
-			disk->fops->swap_slot_free_notify)
-			disk->fops->swap_slot_free_notify(p->bdev, offset);
-	}
+	if (!count)
+		swap_slot_free(p, ent);
 	if (!swap_count(count))
 		mem_cgroup_uncharge_swap(ent);
 	return count;
@@ -1611,6 +1816,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* try_to_unuse() must not find slots held by the slot caches */
+	drain_swap_slots();
+
 	current->flags |= PF_OOM_ORIGIN;
 	err = try_to_unuse(type);
 	current->flags &= ~PF_OOM_ORIGIN;
@@ -1778,9 +1986,131 @@ static const struct file_operations proc_swaps_operations = {
 	.release	= seq_release,
 };
 
+static const char *swap_ra_policies[] = {
+	[SWAP_RA_FIXED]		= "fixed",
+	[SWAP_RA_NONE]		= "none",
+	[SWAP_RA_ADAPTIVE]	= "adaptive",
+};
+
+static int swap_ra_show(struct seq_file *swap, void *v)
+{
+	struct swap_info_struct *ptr = v;
+	unsigned int window;
+	int len;
+
+	if (ptr == SEQ_START_TOKEN) {
+		seq_puts(swap, "Filename\t\t\t\tPolicy\t\tWindow\n");
+		return 0;
+	}
+
+	switch (ptr->ra_policy) {
+	case SWAP_RA_NONE:
+		window = 1;
+		break;
+	case SWAP_RA_ADAPTIVE:
+		window = max(ptr->ra_window, 1U);
+		break;
+	default:
+		window = 1 << page_cluster;
+		break;
+	}
+
+	len = seq_path(swap, &ptr->swap_file->f_path, " \t\n\\");
+	seq_printf(swap, "%*s%-8s\t%u\n",
+			len < 40 ? 40 - len : 1, " ",
+			swap_ra_policies[ptr->ra_policy], window);
+	return 0;
+}
+
+static const struct seq_operations swap_ra_op = {
+	.start =	swap_start,
+	.next =		swap_next,
+	.stop =		swap_stop,
+	.show =		swap_ra_show
+};
+
+static int swap_ra_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &swap_ra_op);
+}
+
+/*
+ * Writing "<swap file or device> <policy>" sets the readahead policy of
+ * an active swap area.
+ */
+static ssize_t swap_ra_write(struct file *file, const char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	struct address_space *mapping;
+	struct file *victim;
+	char *buf, *name, *policy;
+	int type, ra;
+	ssize_t err;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (!count || count >= PATH_MAX)
+		return -EINVAL;
+
+	buf = kmalloc(count + 1, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	err = -EFAULT;
+	if (copy_from_user(buf, ubuf, count))
+		goto out;
+	buf[count] = '\0';
+
+	err = -EINVAL;
+	name = strstrip(buf);
+	policy = strrchr(name, ' ');
+	if (!policy)
+		goto out;
+	*policy++ = '\0';
+	for (ra = 0; ra < ARRAY_SIZE(swap_ra_policies); ra++)
+		if (!strcmp(policy, swap_ra_policies[ra]))
+			break;
+	if (ra == ARRAY_SIZE(swap_ra_policies))
+		goto out;
+
+	victim = filp_open(strstrip(name), O_RDONLY|O_LARGEFILE, 0);
+	err = PTR_ERR(victim);
+	if (IS_ERR(victim))
+		goto out;
+
+	mapping = victim->f_mapping;
+	err = -EINVAL;
+	spin_lock(&swap_lock);
+	for (type = swap_list.head; type >= 0; type = swap_info[type].next) {
+		struct swap_info_struct *p = swap_info + type;
+
+		if ((p->flags & SWP_WRITEOK) &&
+		    p->swap_file->f_mapping == mapping) {
+			p->ra_policy = ra;
+			p->ra_window = 0;
+			err = count;
+			break;
+		}
+	}
+	spin_unlock(&swap_lock);
+	filp_close(victim, NULL);
+out:
+	kfree(buf);
+	return err;
+}
+
+static const struct file_operations proc_swap_ra_operations = {
+	.open		= swap_ra_open,
+	.read		= seq_read,
+	.write		= swap_ra_write,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
 static int __init procswaps_init(void)
 {
 	proc_create("swaps", 0, NULL, &proc_swaps_operations);
+	proc_create("swap_readahead", S_IWUSR | S_IRUGO, NULL,
+		    &proc_swap_ra_operations);
 	return 0;
 }
 __initcall(procswaps_init);
@@ -2012,10 +2342,15 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	}
 
 	if (p->bdev) {
-		if (blk_queue_nonrot(bdev_get_queue(p->bdev))) {
+		struct request_queue *q = bdev_get_queue(p->bdev);
+
+		if (blk_queue_nonrot(q)) {
 			p->flags |= SWP_SOLIDSTATE;
 			p->cluster_next = 1 + (random32() % p->highest_bit);
 		}
+		/* Reading around a fault only costs memory on RAM disks */
+		if (bdi_cap_synchronous_io(&q->backing_dev_info))
+			p->ra_policy = SWAP_RA_NONE;
 		if (discard_swap(p) == 0)
 			p->flags |= SWP_DISCARDABLE;
 	}
@@ -2055,6 +2390,8 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	}
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
+	/* let the next batches come from the new area if it is preferred */
+	drain_swap_slots();
 	error = 0;
 	goto out;
 bad_swap:
@@ -2138,6 +2475,12 @@ static int __swap_duplicate(swp_entry_t entry, bool cache)
 	if (unlikely(offset >= p->max))
 		goto unlock_out;
 
+	/* queued for release by a swap slot cache, as good as free */
+	if (p->swap_map[offset] == SWAP_SLOT_CACHED) {
+		result = -ENOENT;
+		goto unlock_out;
+	}
+
 	count = swap_count(p->swap_map[offset]);
 	has_cache = swap_has_cache(p->swap_map[offset]);
 
@@ -2204,6 +2547,54 @@ get_swap_info_struct(unsigned type)
 	return &swap_info[type];
 }
 
+/*
+ * Order of the block of slots to read around a fault at @target, as set
+ * by the readahead policy of @si.  The adaptive policy sizes the block on
+ * how many of the pages it last read ahead have been used since: it
+ * grows with the hits, up to 1 << page_cluster pages, and halves at most
+ * per fault when they stop, reading single pages only once faults are
+ * not sequential either.  Updated without locking, an occasional lost
+ * update only mis-sizes one readahead.
+ */
+static int swap_readahead_cluster(struct swap_info_struct *si, pgoff_t target)
+{
+	unsigned int hits, pages, last_ra;
+	unsigned int max_pages = 1 << page_cluster;
+
+	switch (si->ra_policy) {
+	case SWAP_RA_NONE:
+		return 0;
+	case SWAP_RA_FIXED:
+		return page_cluster;
+	}
+
+	if (max_pages <= 1)
+		return 0;
+
+	hits = atomic_xchg(&si->ra_hits, 0);
+	pages = hits + 2;
+	if (pages == 2) {
+		/* No hits to judge by, read ahead only sequential faults */
+		if (target != si->ra_prev_offset + 1 &&
+		    target != si->ra_prev_offset - 1)
+			pages = 1;
+	} else
+		pages = roundup_pow_of_two(pages);
+
+	if (pages > max_pages)
+		pages = max_pages;
+
+	/* Don't shrink readahead too fast */
+	last_ra = si->ra_window / 2;
+	if (pages < last_ra)
+		pages = last_ra;
+
+	si->ra_window = pages;
+	si->ra_prev_offset = target;
+
+	return ilog2(pages);
+}
+
 /*
  * swap_lock prevents swap_map being freed. Don't grab an extra
  * reference on the swaphandle, it doesn't matter if it becomes unused.
@@ -2211,16 +2602,18 @@ get_swap_info_struct(unsigned type)
 int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 {
 	struct swap_info_struct *si;
-	int our_page_cluster = page_cluster;
+	int our_page_cluster;
 	pgoff_t target, toff;
 	pgoff_t base, end;
 	int nr_pages = 0;
 
+	si = &swap_info[swp_type(entry)];
+	target = swp_offset(entry);
+
+	our_page_cluster = swap_readahead_cluster(si, target);
 	if (!our_page_cluster)	/* no readahead */
 		return 0;
 
-	si = &swap_info[swp_type(entry)];
-	target = swp_offset(entry);
 	base = (target >> our_page_cluster) << our_page_cluster;
 	end = base + (1 << our_page_cluster);
 	if (!base)		/* first page is swap header */
@@ -2232,16 +2625,19 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 
 	/* Count contiguous allocated slots above our target */
 	for (toff = target; ++toff < end; nr_pages++) {
-		/* Don't read in free or bad pages */
-		if (!si->swap_map[toff])
+		/*
+		 * Don't read in free or bad pages, nor slots without users,
+		 * such as those reserved by a swap slot cache.
+		 */
+		if (!swap_count(si->swap_map[toff]))
 			break;
 		if (swap_count(si->swap_map[toff]) == SWAP_MAP_BAD)
 			break;
 	}
 	/* Count contiguous allocated slots below our target */
 	for (toff = target; --toff >= base; nr_pages++) {
-		/* Don't read in free or bad pages */
-		if (!si->swap_map[toff])
+		/* Don't read in free or bad pages, nor slots without users */
+		if (!swap_count(si->swap_map[toff]))
 			break;
 		if (swap_count(si->swap_map[toff]) == SWAP_MAP_BAD)
 			break;
@@ -181,6 +181,46 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Drop the shadow entries of evicted pages between @start and @end
+ * inclusive, once the pages themselves are gone.
+ */
+static void truncate_shadow_entries(struct address_space *mapping,
+				    pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int i, nr;
+
+	spin_lock_irq(&mapping->tree_lock);
+	while (mapping->nrshadows && index <= end) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, index, PAGEVEC_SIZE);
+		if (!nr)
+			break;
+		for (i = 0; i < nr; i++) {
+			if (indices[i] > end)
+				goto out;
+			if (!radix_tree_exceptional_entry(
+					radix_tree_deref_slot(slots[i])))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			workingset_shadow_removed(mapping);
+		}
+		index = indices[nr - 1] + 1;
+		if (!index)
+			break;
+		/* don't hold off interrupts for the whole mapping */
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+		spin_lock_irq(&mapping->tree_lock);
+	}
+out:
+	spin_unlock_irq(&mapping->tree_lock);
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -214,12 +254,15 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	if (mapping->nrpages == 0)
+		goto shadows;
+
 	pagevec_init(&pvec, 0);
 	next = start;
 	while (next <= end &&
@@ -289,6 +332,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		pagevec_release(&pvec);
 		mem_cgroup_uncharge_end();
 	}
+shadows:
+	if (mapping->nrshadows)
+		truncate_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -386,7 +432,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 	page_cache_release(page);	/* pagecache ref */
@@ -233,6 +233,50 @@ void arch_pick_mmap_layout(struct mm_struct *mm)
 }
 #endif
 
+#ifndef CONFIG_SLQB
+/**
+ * kmem_cache_alloc_bulk - allocate an array of objects from a cache
+ * @s:		the cache to allocate from
+ * @flags:	allocation flags
+ * @nr:		number of objects to allocate
+ * @p:		array that receives the objects
+ *
+ * Returns @nr, or 0 if the objects could not all be allocated, in which
+ * case none are.  SLQB, which has a faster way than one object at a
+ * time, provides its own.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t nr,
+			  void **p)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		p[i] = kmem_cache_alloc(s, flags);
+		if (unlikely(!p[i])) {
+			kmem_cache_free_bulk(s, i, p);
+			return 0;
+		}
+	}
+	return nr;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+/**
+ * kmem_cache_free_bulk - free an array of objects to a cache
+ * @s:		the cache the objects were allocated from
+ * @nr:		number of objects to free
+ * @p:		array of the objects
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+		kmem_cache_free(s, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+#endif
+
 /*
  * Like get_user_pages_fast() except its IRQ-safe in that it won't fall
  * back to the regular GUP.
@@ -660,6 +660,8 @@ static const char * const vmstat_text[] = {
 	"nr_isolated_anon",
 	"nr_isolated_file",
 	"nr_shmem",
+	"workingset_refault",
+	"workingset_activate",
 #ifdef CONFIG_NUMA
 	"numa_hit",
 	"numa_miss",
@@ -674,6 +676,9 @@ static const char * const vmstat_text[] = {
 	"pgpgout",
 	"pswpin",
 	"pswpout",
+	"swap_ra",
+	"swap_ra_hit",
+	"swap_ra_miss",
 
 	TEXTS_FOR_ZONES("pgalloc")
 
@@ -700,6 +705,16 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+#ifdef CONFIG_COMPACTION
+	"compact_blocks_moved",
+	"compact_pages_moved",
+	"compact_pagemigrate_failed",
+	"compact_stall",
+	"compact_fail",
+	"compact_success",
+	"compact_stall_us",
+	"compact_daemon_wake",
+#endif
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
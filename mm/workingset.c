@@ -0,0 +1,264 @@
+/*
+ * mm/workingset.c - workingset detection for the page cache
+ *
+ * When a file page is evicted from the inactive list, a shadow entry
+ * is left in its slot of the page cache radix tree.  If the page is
+ * read back in while the shadow is still there, the refault tells us
+ * the page was thrashing out of the inactive list, and whether it
+ * would have stayed in memory had it been activated.
+ *
+ * Every zone keeps a counter, inactive_age, that is advanced by every
+ * eviction from and every activation out of its inactive file list.
+ * The shadow entry records the counter at eviction, so at refault time
+ * the difference to the current counter is the number of pages that
+ * left the inactive list in between: the refault distance.
+ *
+ * A page that is read back in after a refault distance of R would have
+ * stayed cached had the inactive list been R pages longer.  Those pages
+ * can only come from the active list, so when R is at most the size of
+ * the active file list, the page is put on the active list right away
+ * where it competes with the current workingset, instead of being
+ * evicted again from the inactive list before it is referenced twice.
+ *
+ * The shadow entries are dropped when the mapping is truncated, or when
+ * the page is read back in.  Beyond that, a shrinker drops shadows while
+ * there are more of them than pages on the file LRU lists: a refault
+ * distance larger than that could not have been bridged by activation
+ * anyway, and the radix tree nodes holding nothing but shadows would
+ * otherwise stay around for as long as the inode.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/mmzone.h>
+#include <linux/pagevec.h>
+#include <linux/radix-tree.h>
+#include <linux/spinlock.h>
+#include <linux/vmstat.h>
+
+/*
+ * The shadow entry packs the zone the page was in and the eviction
+ * counter; the counter is truncated to what is left of a long.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Mappings with shadow entries are kept on shadow_mappings, in the order
+ * the shrinker visits them.  shadow_mappings_lock nests inside the
+ * tree_lock of the mappings; the shrinker, which goes the other way,
+ * only trylocks the tree_lock.
+ */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_mappings_lock);
+static atomic_long_t nr_shadows;
+
+/* Where the shrinker left off in the mapping at the head of the list */
+static struct address_space *shadow_scan_mapping;
+static pgoff_t shadow_scan_index;
+
+/**
+ * workingset_shadow_added - note a new shadow entry
+ * @mapping: address space the shadow was stored in
+ *
+ * Called with @mapping->tree_lock held, after incrementing nrshadows.
+ */
+void workingset_shadow_added(struct address_space *mapping)
+{
+	atomic_long_inc(&nr_shadows);
+	if (mapping->nrshadows == 1) {
+		spin_lock(&shadow_mappings_lock);
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+		spin_unlock(&shadow_mappings_lock);
+	}
+}
+
+/**
+ * workingset_shadow_removed - note that a shadow entry is gone
+ * @mapping: address space the shadow was removed from
+ *
+ * Called with @mapping->tree_lock held, after decrementing nrshadows.
+ */
+void workingset_shadow_removed(struct address_space *mapping)
+{
+	atomic_long_dec(&nr_shadows);
+	if (!mapping->nrshadows) {
+		spin_lock(&shadow_mappings_lock);
+		list_del(&mapping->shadow_list);
+		spin_unlock(&shadow_mappings_lock);
+	}
+}
+
+/*
+ * Drop shadow entries of @mapping, scanning up to @nr slots from where
+ * the last call left off, and move the mapping to the tail of the list
+ * once its end is reached.  The last shadow is left alone, so that the
+ * mapping stays on the list and whoever frees it has to take the
+ * tree_lock to truncate it, which waits for the shrinker to be done.
+ * Called with both shadow_mappings_lock and the tree_lock held.
+ */
+static int shrink_mapping_shadows(struct address_space *mapping, int nr)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i, found;
+	int scanned = 0;
+
+	while (scanned < nr) {
+		found = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+				indices, shadow_scan_index,
+				min_t(int, PAGEVEC_SIZE, nr - scanned));
+		if (!found)
+			goto wrap;
+		for (i = 0; i < found; i++) {
+			if (mapping->nrshadows == 1)
+				break;
+			if (!radix_tree_exceptional_entry(
+					radix_tree_deref_slot(slots[i])))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			atomic_long_dec(&nr_shadows);
+		}
+		scanned += found;
+		shadow_scan_index = indices[found - 1] + 1;
+		if (!shadow_scan_index || mapping->nrshadows == 1)
+			goto wrap;
+	}
+	return scanned;
+wrap:
+	shadow_scan_index = 0;
+	list_move_tail(&mapping->shadow_list, &shadow_mappings);
+	return scanned + 1;
+}
+
+/* Shadows beyond the number of pages on the file LRU lists */
+static long shadow_excess(void)
+{
+	long excess = atomic_long_read(&nr_shadows) -
+		      (long)(global_page_state(NR_ACTIVE_FILE) +
+			     global_page_state(NR_INACTIVE_FILE));
+
+	return excess > 0 ? excess : 0;
+}
+
+static int shadow_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct address_space *mapping;
+
+	if (!nr_to_scan || !shadow_excess())
+		goto out;
+
+	spin_lock_irq(&shadow_mappings_lock);
+	while (nr_to_scan > 0 && !list_empty(&shadow_mappings)) {
+		mapping = list_first_entry(&shadow_mappings,
+					   struct address_space, shadow_list);
+		if (mapping != shadow_scan_mapping) {
+			shadow_scan_mapping = mapping;
+			shadow_scan_index = 0;
+		}
+		if (!spin_trylock(&mapping->tree_lock)) {
+			list_move_tail(&mapping->shadow_list, &shadow_mappings);
+			break;
+		}
+		nr_to_scan -= shrink_mapping_shadows(mapping, nr_to_scan);
+		spin_unlock(&mapping->tree_lock);
+	}
+	spin_unlock_irq(&shadow_mappings_lock);
+out:
+	return shadow_excess();
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shadow_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
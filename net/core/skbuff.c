@@ -437,6 +437,41 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+#define SKB_FREE_BULK	16
+
+/**
+ *	__kfree_skb_list - private function
+ *	@skb: list of buffers linked through ->next
+ *
+ *	Free a list of sk_buffs that have no users left, like __kfree_skb()
+ *	on each of them, but with the heads returned to their cache in bulk.
+ */
+void __kfree_skb_list(struct sk_buff *skb)
+{
+	void *heads[SKB_FREE_BULK];
+	int n = 0;
+
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		WARN_ON(atomic_read(&skb->users));
+		skb_release_all(skb);
+		if (skb->fclone == SKB_FCLONE_UNAVAILABLE) {
+			heads[n++] = skb;
+			if (n == SKB_FREE_BULK) {
+				kmem_cache_free_bulk(skbuff_head_cache, n,
+						     heads);
+				n = 0;
+			}
+		} else
+			kfree_skbmem(skb);
+		skb = next;
+	}
+	if (n)
+		kmem_cache_free_bulk(skbuff_head_cache, n, heads);
+}
+EXPORT_SYMBOL(__kfree_skb_list);
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
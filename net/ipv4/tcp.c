@@ -1103,7 +1103,8 @@ out:
 	TCP_CHECK_TIMER(sk);
 	release_sock(sk);
 	if (copied > 0)
-		update_tcp_snd(current_uid(), copied);
+		update_tcp_snd(current_uid(), sk, copied,
+			       DIV_ROUND_UP(copied, mss_now));
 	return copied;
 
 do_fault:
@@ -1349,7 +1350,9 @@ int tcp_read_sock(struct sock *sk, read_descriptor_t *desc,
 	/* Clean up data we have read: This will do ACK frames. */
 	if (copied > 0) {
 		tcp_cleanup_rbuf(sk, copied);
-		update_tcp_rcv(current_uid(), copied);
+		update_tcp_rcv(current_uid(), sk, copied,
+			       DIV_ROUND_UP(copied,
+				max_t(int, inet_csk(sk)->icsk_ack.rcv_mss, 1)));
 	}
 	return copied;
 }
@@ -1747,7 +1750,9 @@ skip_copy:
 	TCP_CHECK_TIMER(sk);
 	release_sock(sk);
 	if (copied > 0)
-		update_tcp_rcv(current_uid(), copied);
+		update_tcp_rcv(current_uid(), sk, copied,
+			       DIV_ROUND_UP(copied,
+				max_t(int, inet_csk(sk)->icsk_ack.rcv_mss, 1)));
 	return copied;
 
 out:
@@ -1758,7 +1763,7 @@ out:
 recv_urg:
 	err = tcp_recv_urg(sk, msg, len, flags);
 	if (err > 0)
-		update_tcp_rcv(current_uid(), err);
+		update_tcp_rcv(current_uid(), sk, err, 1);
 	goto out;
 }
 
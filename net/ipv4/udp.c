@@ -771,7 +771,7 @@ out:
 	if (free)
 		kfree(ipc.opt);
 	if (!err) {
-		update_tcp_snd(current_uid(), len);
+		update_tcp_snd(current_uid(), sk, len, 1);
 		return len;
 	}
 	/*
@@ -1004,7 +1004,7 @@ try_again:
 out_free:
 	skb_free_datagram_locked(sk, skb);
 	if (err > 0)
-		update_tcp_rcv(current_uid(), err);
+		update_tcp_rcv(current_uid(), sk, err, 1);
 out:
 	return err;
 